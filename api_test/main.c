@@ -796,6 +796,36 @@ static void utf8(test_batch_runner *runner) {
       string_with_bom, sizeof(string_with_bom) - 1, CMARK_OPT_DEFAULT);
   STR_EQ(runner, html, "<h1>Hello</h1>\n", "utf8 with BOM");
   free(html);
+
+  // Inputs long enough for the whole-buffer check, fed in two pieces that
+  // split multibyte sequences.
+  static const char long_valid[] =
+      "\xe4\xb8\xad\xe6\x96\x87 longer than a vector \xf0\x9f\x98\x80\n";
+  static const char long_invalid[] =
+      "\xe4\xb8\xad\xe6\x96\x87 longer than a \xff vector \xed\xa0\x80\n";
+  size_t split;
+  for (split = 1; split < sizeof(long_valid) - 1; ++split) {
+    cmark_parser *parser = cmark_parser_new(CMARK_OPT_VALIDATE_UTF8);
+    cmark_parser_feed(parser, long_valid, split);
+    cmark_parser_feed(parser, long_valid + split,
+                      sizeof(long_valid) - 1 - split);
+    cmark_node *doc = cmark_parser_finish(parser);
+    html = cmark_render_html(doc, CMARK_OPT_DEFAULT, NULL);
+    STR_EQ(runner, html,
+           "<p>\xe4\xb8\xad\xe6\x96\x87 longer than a vector "
+           "\xf0\x9f\x98\x80</p>\n",
+           "valid utf8 split at %zu", split);
+    free(html);
+    cmark_node_free(doc);
+    cmark_parser_free(parser);
+  }
+  html = cmark_markdown_to_html(long_invalid, sizeof(long_invalid) - 1,
+                                CMARK_OPT_VALIDATE_UTF8);
+  STR_EQ(runner, html,
+         "<p>\xe4\xb8\xad\xe6\x96\x87 longer than a " UTF8_REPL
+         " vector " UTF8_REPL "</p>\n",
+         "long invalid utf8");
+  free(html);
 }
 
 static void test_char(test_batch_runner *runner, int valid, const char *utf8,
@@ -994,6 +1024,76 @@ static void test_pathological_regressions(test_batch_runner *runner) {
   }
 }
 
+static void blank_lines_in_nested_blocks(test_batch_runner *runner) {
+  test_md_to_html(runner, "- a\n  - b\n\n  c\n- d\n",
+                  "<ul>\n<li>\n<p>a</p>\n<ul>\n<li>b</li>\n</ul>\n<p>c</p>\n"
+                  "</li>\n<li>\n<p>d</p>\n</li>\n</ul>\n",
+                  "blank line in a sublist makes the outer list loose");
+  test_md_to_html(runner, "- a\n  - b\n\n    c\n  - e\n- d\n",
+                  "<ul>\n<li>a\n<ul>\n<li>\n<p>b</p>\n<p>c</p>\n</li>\n"
+                  "<li>\n<p>e</p>\n</li>\n</ul>\n</li>\n<li>d</li>\n</ul>\n",
+                  "blank line in a subitem makes only the sublist loose");
+  test_md_to_html(runner, "- a\n  > b\n  >\n  > c\n- d\n",
+                  "<ul>\n<li>a\n<blockquote>\n<p>b</p>\n<p>c</p>\n"
+                  "</blockquote>\n</li>\n<li>d</li>\n</ul>\n",
+                  "blank line in a block quote leaves the list tight");
+}
+
+static void fenced_code_lines(test_batch_runner *runner) {
+  static const char markdown[] = "```\n"
+                                 "a\n"
+                                 "b\r\n"
+                                 "c\0d\n"
+                                 "   ``` not a fence\n"
+                                 "  ```\n"
+                                 "~~~\n"
+                                 "x\n"
+                                 "yz";
+  cmark_parser *parser = cmark_parser_new(CMARK_OPT_DEFAULT);
+  cmark_node *doc, *code;
+  size_t i;
+
+  for (i = 0; i < sizeof(markdown) - 1; i += 5)
+    cmark_parser_feed(parser, markdown + i,
+                      i + 5 < sizeof(markdown) - 1 ? 5 : sizeof(markdown) - 1 - i);
+  doc = cmark_parser_finish(parser);
+
+  code = cmark_node_first_child(doc);
+  STR_EQ(runner, cmark_node_get_literal(code),
+         "a\nb\nc\xef\xbf\xbd" "d\n   ``` not a fence\n",
+         "fenced code keeps its lines across feeds");
+  code = cmark_node_next(code);
+  STR_EQ(runner, cmark_node_get_literal(code), "x\nyz\n",
+         "unclosed fenced code runs to the end");
+  INT_EQ(runner, cmark_node_get_end_line(code), 9, "unclosed fence end line");
+  INT_EQ(runner, cmark_node_get_end_column(code), 2,
+         "unclosed fence end column");
+
+  cmark_node_free(doc);
+  cmark_parser_free(parser);
+}
+
+static void html_block_lines(test_batch_runner *runner) {
+  static const char *const cases[][3] = {
+      {"<script>\nif (a > b)\n\n  x = '</scrip>';\n</SCRIPT>\nc\n",
+       "<script>\nif (a > b)\n\n  x = '</scrip>';\n</SCRIPT>\n<p>c</p>\n",
+       "script block ends at the end tag in any case"},
+      {"<!-- a -> b\n- ->\nc -->d\ne\n", "<!-- a -> b\n- ->\nc -->d\n<p>e</p>\n",
+       "comment ends at the line with -->"},
+      {"<![CDATA[\n] ]>\n]]>\n\n<?x\n>\n?>\nf\n",
+       "<![CDATA[\n] ]>\n]]>\n<?x\n>\n?>\n<p>f</p>\n",
+       "CDATA and processing instructions end at ]]> and ?>"},
+  };
+  size_t i;
+
+  for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    char *html = cmark_markdown_to_html(cases[i][0], strlen(cases[i][0]),
+                                        CMARK_OPT_UNSAFE);
+    STR_EQ(runner, html, cases[i][1], cases[i][2]);
+    free(html);
+  }
+}
+
 static void source_pos(test_batch_runner *runner) {
   static const char markdown[] =
     "# Hi *there*.\n"
@@ -1147,6 +1247,30 @@ static void source_pos_inlines(test_batch_runner *runner) {
     free(xml);
     cmark_node_free(doc);
   }
+  {
+    static const char markdown[] =
+      "a `b\n"
+      "c\n"
+      "d` <span\n"
+      "x=\"y\">\n";
+
+    cmark_node *doc = cmark_parse_document(markdown, sizeof(markdown) - 1, CMARK_OPT_SOURCEPOS);
+    char *xml = cmark_render_xml(doc, CMARK_OPT_DEFAULT | CMARK_OPT_SOURCEPOS);
+    STR_EQ(runner, xml, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                        "<!DOCTYPE document SYSTEM \"CommonMark.dtd\">\n"
+                        "<document sourcepos=\"1:1-4:6\" xmlns=\"http://commonmark.org/xml/1.0\">\n"
+                        "  <paragraph sourcepos=\"1:1-4:6\">\n"
+                        "    <text sourcepos=\"1:1-1:2\" xml:space=\"preserve\">a </text>\n"
+                        "    <code sourcepos=\"1:4-3:1\" xml:space=\"preserve\">b c d</code>\n"
+                        "    <text sourcepos=\"3:3-3:3\" xml:space=\"preserve\"> </text>\n"
+                        "    <html_inline sourcepos=\"3:4-4:5\" xml:space=\"preserve\">&lt;span\n"
+                        "x=&quot;y&quot;&gt;</html_inline>\n"
+                        "  </paragraph>\n"
+                        "</document>\n",
+                        "sourcepos of inlines spanning lines are as expected");
+    free(xml);
+    cmark_node_free(doc);
+  }
 }
 
 static void ref_source_pos(test_batch_runner *runner) {
@@ -1390,6 +1514,9 @@ static void parser_interrupt(test_batch_runner *runner) {
   cmark_syntax_extension *my_ext = cmark_syntax_extension_new("interrupt");
   cmark_syntax_extension_set_private(my_ext, (void *)&run_inner_parser, NULL);
   cmark_syntax_extension_set_match_inline_func(my_ext, reentrant_parse_inline_ext);
+  cmark_syntax_extension_set_special_inline_chars(
+      my_ext, cmark_llist_append(cmark_get_default_mem_allocator(), NULL,
+                                 (void *)'t'));
 
   cmark_parser *parser = cmark_parser_new(CMARK_OPT_DEFAULT);
   cmark_parser_attach_syntax_extension(parser, cmark_find_syntax_extension("strikethrough"));
@@ -1411,6 +1538,8 @@ static void parser_interrupt(test_batch_runner *runner) {
          "    <text xml:space=\"preserve\"> outer document</text>\n"
          "  </paragraph>\n"
          "</document>\n", "interrupting the parser should still allow extensions");
+  OK(runner, cmark_syntax_extension_get_private(my_ext) == NULL,
+     "the inner parser ran from match_inline");
 
   free(xml);
   cmark_node_free(doc);
@@ -1418,6 +1547,137 @@ static void parser_interrupt(test_batch_runner *runner) {
   cmark_syntax_extension_free(cmark_get_default_mem_allocator(), my_ext);
 }
 
+typedef struct {
+  int calls;
+  int cancel_after;
+} cancel_state;
+
+static int count_and_cancel(void *data) {
+  cancel_state *state = (cancel_state *)data;
+  return ++state->calls > state->cancel_after;
+}
+
+static void parser_cancel(test_batch_runner *runner) {
+  cancel_state state = {0, 2};
+  static const char line[] = "> line [^1]\n\n";
+  static const char note[] = "[^1]: note\n";
+  static const char emph[] = "*a* ";
+  cmark_parser *parser = cmark_parser_new(CMARK_OPT_FOOTNOTES);
+  char *buf = (char *)malloc(10000 * (sizeof(line) - 1) + sizeof(note));
+  size_t len = 0;
+  cmark_node *doc;
+  char *html;
+  int i;
+
+  // Cancelled while processing lines.
+  for (i = 0; i < 10000; ++i, len += sizeof(line) - 1)
+    memcpy(buf + len, line, sizeof(line) - 1);
+  memcpy(buf + len, note, sizeof(note) - 1);
+  len += sizeof(note) - 1;
+  cmark_parser_set_cancel_func(parser, count_and_cancel, &state);
+  cmark_parser_feed(parser, buf, len);
+  OK(runner, cmark_parser_is_cancelled(parser), "parse is cancelled");
+  INT_EQ(runner, state.calls, 3, "no more calls once cancelled");
+  doc = cmark_parser_finish(parser);
+  OK(runner, doc == NULL, "cancelled parse returns NULL");
+  OK(runner, !cmark_parser_is_cancelled(parser), "finish resets the parser");
+
+  // Cancelled while parsing inlines.
+  for (len = 0, i = 0; i < 10000; ++i, len += sizeof(emph) - 1)
+    memcpy(buf + len, emph, sizeof(emph) - 1);
+  state.calls = 0;
+  state.cancel_after = 1000;
+  cmark_parser_feed(parser, buf, len);
+  OK(runner, !cmark_parser_is_cancelled(parser), "one line is not cancelled");
+  state.cancel_after = state.calls;
+  doc = cmark_parser_finish(parser);
+  OK(runner, doc == NULL, "parse cancelled in inlines returns NULL");
+
+  // The parser can be reused.
+  state.cancel_after = 1000;
+  cmark_parser_feed(parser, "*a*\n", 4);
+  doc = cmark_parser_finish(parser);
+  html = cmark_render_html(doc, CMARK_OPT_DEFAULT, NULL);
+  STR_EQ(runner, html, "<p><em>a</em></p>\n", "parser is reused after cancelling");
+  free(html);
+  cmark_node_free(doc);
+
+  free(buf);
+  cmark_parser_free(parser);
+}
+
+static void accounting_mem(test_batch_runner *runner) {
+  static const char line[] = "some *text* and [a link](/url)\n\n";
+  cmark_mem *mem = cmark_accounting_mem_new(0);
+  cmark_mem_stats stats;
+  cmark_parser *parser;
+  cmark_node *doc;
+  char *buf, *html;
+  size_t len = 0;
+  int i;
+
+  OK(runner, !cmark_accounting_mem_get_stats(cmark_get_default_mem_allocator(), &stats),
+     "default allocator has no statistics");
+
+  parser = cmark_parser_new_with_mem(CMARK_OPT_DEFAULT, mem);
+  cmark_parser_feed(parser, line, sizeof(line) - 1);
+  doc = cmark_parser_finish(parser);
+  cmark_parser_free(parser);
+  OK(runner, cmark_accounting_mem_get_stats(mem, &stats), "accounting allocator has statistics");
+  OK(runner, stats.current_bytes > 0, "document memory is counted");
+  OK(runner, stats.peak_bytes >= stats.current_bytes, "peak is at least current");
+  OK(runner, stats.allocations > 0, "allocations are counted");
+  OK(runner, !stats.over_budget, "no budget");
+
+  cmark_accounting_mem_reset_stats(mem);
+  html = cmark_render_html_with_mem(doc, CMARK_OPT_DEFAULT, NULL, mem);
+  cmark_accounting_mem_get_stats(mem, &stats);
+  OK(runner, stats.allocations > 0, "rendering allocations are counted");
+  mem->free(html);
+  cmark_node_free(doc);
+  cmark_accounting_mem_get_stats(mem, &stats);
+  INT_EQ(runner, (int)stats.current_bytes, 0, "everything is freed");
+  cmark_accounting_mem_free(mem);
+
+  // A block reallocated through another allocator moves to it.
+  {
+    cmark_mem *first = cmark_accounting_mem_new(1000);
+    cmark_mem *second = cmark_accounting_mem_new(1000);
+    char *block = (char *)first->calloc(1, 100);
+
+    block = (char *)second->realloc(block, 200);
+    cmark_accounting_mem_get_stats(first, &stats);
+    INT_EQ(runner, (int)stats.current_bytes, 0,
+           "reallocated block leaves the first allocator");
+    OK(runner, !stats.over_budget, "first allocator is not over budget");
+    cmark_accounting_mem_get_stats(second, &stats);
+    INT_EQ(runner, (int)stats.current_bytes, 200,
+           "reallocated block is counted by the second allocator");
+    second->free(block);
+    cmark_accounting_mem_free(first);
+    cmark_accounting_mem_free(second);
+  }
+
+  // A parse over budget is cancelled.
+  buf = (char *)malloc(10000 * (sizeof(line) - 1));
+  for (i = 0; i < 10000; ++i, len += sizeof(line) - 1)
+    memcpy(buf + len, line, sizeof(line) - 1);
+  mem = cmark_accounting_mem_new(100000);
+  parser = cmark_parser_new_with_mem(CMARK_OPT_DEFAULT, mem);
+  cmark_parser_feed(parser, buf, len);
+  OK(runner, cmark_parser_is_cancelled(parser), "parse over budget is cancelled");
+  doc = cmark_parser_finish(parser);
+  OK(runner, doc == NULL, "parse over budget returns NULL");
+  cmark_accounting_mem_get_stats(mem, &stats);
+  OK(runner, stats.over_budget, "allocator is over budget");
+  OK(runner, stats.peak_bytes < 200000, "parse stops soon after the budget");
+  cmark_parser_free(parser);
+  cmark_accounting_mem_get_stats(mem, &stats);
+  INT_EQ(runner, (int)stats.current_bytes, 0, "cancelled parse is freed");
+  cmark_accounting_mem_free(mem);
+  free(buf);
+}
+
 static void compare_table_spans_html(test_batch_runner *runner, const char *markdown, bool use_ditto,
                                      const char *expected_html, const char *msg) {
   int options = CMARK_OPT_TABLE_SPANS;
@@ -1572,6 +1832,601 @@ static void table_spans(test_batch_runner *runner) {
   }
 }
 
+static int capacity_reallocs;
+
+static void *capacity_calloc(size_t nmem, size_t size) {
+  return calloc(nmem, size);
+}
+
+static void *capacity_realloc(void *ptr, size_t size) {
+  capacity_reallocs++;
+  return realloc(ptr, size);
+}
+
+static void render_capacity(test_batch_runner *runner) {
+  static const char block[] = "Some *emphasis*, `code` and a [link](/url).\n\n"
+                              "- item\n- item\n\n";
+  cmark_mem mem = {capacity_calloc, capacity_realloc, free};
+  char *markdown = (char *)malloc(200 * (sizeof(block) - 1));
+  size_t len = 0;
+  int i;
+
+  for (i = 0; i < 200; ++i, len += sizeof(block) - 1)
+    memcpy(markdown + len, block, sizeof(block) - 1);
+
+  cmark_node *doc = cmark_parse_document(markdown, len, CMARK_OPT_DEFAULT);
+  char *expected = cmark_render_html(doc, CMARK_OPT_DEFAULT, NULL);
+
+  capacity_reallocs = 0;
+  char *html = cmark_render_html_with_mem(doc, CMARK_OPT_DEFAULT, NULL, &mem);
+  STR_EQ(runner, html, expected, "estimated capacity renders identical html");
+  OK(runner, capacity_reallocs <= 2,
+     "estimated capacity avoids repeated html buffer growth");
+  free(html);
+
+  capacity_reallocs = 0;
+  html = cmark_render_html_with_mem_and_capacity(doc, CMARK_OPT_DEFAULT, NULL,
+                                                 &mem, strlen(expected) + 1);
+  STR_EQ(runner, html, expected, "explicit capacity renders identical html");
+  INT_EQ(runner, capacity_reallocs, 1,
+         "explicit capacity allocates html buffer once");
+  free(html);
+  free(expected);
+
+  expected = cmark_render_xml(doc, CMARK_OPT_DEFAULT);
+  capacity_reallocs = 0;
+  char *xml = cmark_render_xml_with_mem(doc, CMARK_OPT_DEFAULT, &mem);
+  STR_EQ(runner, xml, expected, "estimated capacity renders identical xml");
+  OK(runner, capacity_reallocs <= 2,
+     "estimated capacity avoids repeated xml buffer growth");
+  free(xml);
+  free(expected);
+
+  expected = cmark_render_commonmark(doc, CMARK_OPT_DEFAULT, 0);
+  char *commonmark = cmark_render_commonmark_with_mem_and_capacity(
+      doc, CMARK_OPT_DEFAULT, 0, &mem, 16);
+  STR_EQ(runner, commonmark, expected,
+         "small explicit capacity renders identical commonmark");
+  free(commonmark);
+  free(expected);
+
+  cmark_node_free(doc);
+  free(markdown);
+
+  doc = cmark_parse_document("", 0, CMARK_OPT_DEFAULT);
+  html = cmark_render_html_with_mem_and_capacity(doc, CMARK_OPT_DEFAULT, NULL,
+                                                 &mem, 64);
+  STR_EQ(runner, html, "", "reserved capacity renders empty document");
+  free(html);
+  cmark_node_free(doc);
+}
+
+static void lazy_inlines(test_batch_runner *runner) {
+  static const char markdown[] = "# Title *one*\n"
+                                 "\n"
+                                 "First [link].\n"
+                                 "\n"
+                                 "> Second *paragraph*.\n"
+                                 "\n"
+                                 "[link]: /url \"title\"\n";
+  cmark_node *eager =
+      cmark_parse_document(markdown, sizeof(markdown) - 1, CMARK_OPT_DEFAULT);
+  cmark_node *doc = cmark_parse_document(markdown, sizeof(markdown) - 1,
+                                         CMARK_OPT_LAZY_INLINES);
+
+  cmark_node *heading = doc->first_child;
+  cmark_node *paragraph = heading->next;
+  cmark_node *quoted = paragraph->next->first_child;
+  OK(runner, heading->first_child == NULL &&
+                 (heading->flags & CMARK_NODE__INLINES_PENDING),
+     "heading inlines are deferred");
+  OK(runner, quoted->first_child == NULL &&
+                 (quoted->flags & CMARK_NODE__INLINES_PENDING),
+     "nested paragraph inlines are deferred");
+
+  cmark_node *text = cmark_node_first_child(heading);
+  INT_EQ(runner, cmark_node_get_type(text), CMARK_NODE_TEXT,
+         "first_child parses heading inlines");
+  INT_EQ(runner, cmark_node_get_type(cmark_node_next(text)), CMARK_NODE_EMPH,
+         "heading inlines are complete");
+  OK(runner, paragraph->flags & CMARK_NODE__INLINES_PENDING,
+     "other blocks stay deferred");
+
+  char *expected = cmark_render_html(eager, CMARK_OPT_DEFAULT, NULL);
+  char *html = cmark_render_html(doc, CMARK_OPT_DEFAULT, NULL);
+  STR_EQ(runner, html, expected, "lazy parse renders like eager parse");
+  free(html);
+  free(expected);
+  cmark_node_free(doc);
+
+  // Inlines of a block moved out of its document are parsed on the way out.
+  doc = cmark_parse_document(markdown, sizeof(markdown) - 1,
+                             CMARK_OPT_LAZY_INLINES);
+  paragraph = doc->first_child->next;
+  cmark_node_unlink(paragraph);
+  cmark_node_free(doc);
+  cmark_node *link = cmark_node_next(cmark_node_first_child(paragraph));
+  INT_EQ(runner, cmark_node_get_type(link), CMARK_NODE_LINK,
+         "unlinked block keeps its inlines");
+  STR_EQ(runner, cmark_node_get_url(link), "/url",
+         "unlinked block keeps resolved references");
+  cmark_node_free(paragraph);
+
+  cmark_node_free(eager);
+}
+
+static void serialize_roundtrip(test_batch_runner *runner) {
+  static const char markdown[] = "# Title\n"
+                                 "\n"
+                                 "- [x] done\n"
+                                 "- *item* with `code`[^1]\n"
+                                 "\n"
+                                 "| a | b |\n"
+                                 "| :- | -: |\n"
+                                 "| span ||\n"
+                                 "\n"
+                                 "```c\n"
+                                 "int x;\n"
+                                 "```\n"
+                                 "\n"
+                                 "[^1]: A [link](/url \"title\").\n";
+  int options = CMARK_OPT_FOOTNOTES | CMARK_OPT_TABLE_SPANS | CMARK_OPT_SOURCEPOS;
+  cmark_parser *parser = cmark_parser_new(options);
+  cmark_parser_attach_syntax_extension(parser, cmark_find_syntax_extension("table"));
+  cmark_parser_attach_syntax_extension(parser, cmark_find_syntax_extension("tasklist"));
+  cmark_parser_feed(parser, markdown, sizeof(markdown) - 1);
+  cmark_node *doc = cmark_parser_finish(parser);
+  cmark_parser_free(parser);
+
+  size_t len;
+  char *data = cmark_serialize(doc, &len);
+  cmark_node *copy = cmark_deserialize(data, len);
+  OK(runner, copy != NULL, "deserialize serialized document");
+
+  char *expected = cmark_render_html(doc, options, NULL);
+  char *html = cmark_render_html(copy, options, NULL);
+  STR_EQ(runner, html, expected, "deserialized document renders the same html");
+  free(html);
+  free(expected);
+
+  expected = cmark_render_xml(doc, options);
+  char *xml = cmark_render_xml(copy, options);
+  STR_EQ(runner, xml, expected, "deserialized document renders the same xml");
+  free(xml);
+  free(expected);
+
+  OK(runner, cmark_deserialize(data, len - 1) == NULL,
+     "truncated data is rejected");
+  data[0] = 'X';
+  OK(runner, cmark_deserialize(data, len) == NULL,
+     "data without the header is rejected");
+
+  free(data);
+  cmark_node_free(copy);
+  cmark_node_free(doc);
+}
+
+static void deserialize_corrupted(test_batch_runner *runner) {
+  static const char markdown[] = "|a|\n|-|\n|b|\n";
+  // The data of the first cell: a column span of 1, a row span of 1 and
+  // index 0.
+  static const unsigned char cell_data[] = {1, 0, 0, 0, 1, 0, 0, 0,
+                                            0, 0, 0, 0};
+  cmark_parser *parser = cmark_parser_new(CMARK_OPT_DEFAULT);
+  cmark_node *doc, *cell;
+  char *data;
+  size_t len, i;
+
+  cmark_parser_attach_syntax_extension(parser, cmark_find_syntax_extension("table"));
+  cmark_parser_feed(parser, markdown, sizeof(markdown) - 1);
+  doc = cmark_parser_finish(parser);
+  cmark_parser_free(parser);
+
+  data = cmark_serialize(doc, &len);
+  for (i = 0; i + sizeof(cell_data) <= len; i++) {
+    if (memcmp(data + i, cell_data, sizeof(cell_data)) == 0)
+      break;
+  }
+  OK(runner, i + sizeof(cell_data) <= len, "cell data is serialized");
+  if (i + sizeof(cell_data) <= len) {
+    data[i + 10] = 0x10;
+    OK(runner, cmark_deserialize(data, len) == NULL,
+       "cell index beyond the table is rejected");
+  }
+  free(data);
+
+  cell = cmark_node_first_child(cmark_node_first_child(cmark_node_first_child(doc)));
+  data = cmark_serialize(cell, &len);
+  OK(runner, cmark_deserialize(data, len) == NULL,
+     "cell outside a table row is rejected");
+  free(data);
+
+  data = cmark_serialize(cmark_node_parent(cell), &len);
+  OK(runner, cmark_deserialize(data, len) == NULL,
+     "row outside a table is rejected");
+  free(data);
+
+  cmark_node_free(doc);
+}
+
+// Serialize `node` twice, with `set` applied with `good` and with `good + 1`,
+// overwrite the bytes that differ with the zigzag varint `bad` and check
+// that the tampered data is rejected.
+static void check_tampered(test_batch_runner *runner, cmark_node *node,
+                           int (*set)(cmark_node *, int), int good,
+                           unsigned char bad, const char *msg) {
+  char *a, *b;
+  size_t len_a, len_b, i, n_diff = 0;
+
+  set(node, good);
+  a = cmark_serialize(node, &len_a);
+  set(node, good + 1);
+  b = cmark_serialize(node, &len_b);
+  INT_EQ(runner, (int)len_a, (int)len_b, "%s: same length", msg);
+  if (len_a == len_b) {
+    for (i = 0; i < len_a; ++i) {
+      if (a[i] != b[i]) {
+        a[i] = (char)bad;
+        n_diff++;
+      }
+    }
+    INT_EQ(runner, (int)n_diff, 1, "%s: one byte differs", msg);
+    OK(runner, cmark_deserialize(a, len_a) == NULL, "%s", msg);
+  }
+  free(a);
+  free(b);
+}
+
+static void deserialize_out_of_range(test_batch_runner *runner) {
+  cmark_node *heading = cmark_node_new(CMARK_NODE_HEADING);
+  cmark_node *list = cmark_node_new(CMARK_NODE_LIST);
+
+  cmark_node_append_child(heading, cmark_node_new(CMARK_NODE_TEXT));
+  cmark_node_set_list_type(list, CMARK_ORDERED_LIST);
+
+  // Zigzag varints: 0 is 0, -1 is 1 and 7 is 14.
+  check_tampered(runner, heading, cmark_node_set_heading_level, 1, 0,
+                 "heading level 0 is rejected");
+  check_tampered(runner, heading, cmark_node_set_heading_level, 5, 14,
+                 "heading level 7 is rejected");
+  check_tampered(runner, list, cmark_node_set_list_start, 1, 1,
+                 "negative list start is rejected");
+
+  cmark_node_free(heading);
+  cmark_node_free(list);
+}
+
+static void render_multi(test_batch_runner *runner) {
+  static const char markdown[] = "# Title\n"
+                                 "\n"
+                                 "Some *text* with <https://example.com> and\n"
+                                 "a [link](/url).\n"
+                                 "\n"
+                                 "1. one\n"
+                                 "2. two\n";
+  cmark_node *doc =
+      cmark_parse_document(markdown, sizeof(markdown) - 1, CMARK_OPT_DEFAULT);
+  cmark_render_target targets[] = {
+      {CMARK_FORMAT_HTML, CMARK_OPT_SOURCEPOS, 0, NULL, NULL},
+      {CMARK_FORMAT_XML, CMARK_OPT_DEFAULT, 0, NULL, NULL},
+      {CMARK_FORMAT_MAN, CMARK_OPT_DEFAULT, 20, NULL, NULL},
+      {CMARK_FORMAT_COMMONMARK, CMARK_OPT_DEFAULT, 20, NULL, NULL},
+      {CMARK_FORMAT_PLAINTEXT, CMARK_OPT_DEFAULT, 0, NULL, NULL},
+      {CMARK_FORMAT_LATEX, CMARK_OPT_DEFAULT, 0, NULL, NULL},
+  };
+  char *expected[6];
+  int i;
+
+  expected[0] = cmark_render_html(doc, CMARK_OPT_SOURCEPOS, NULL);
+  expected[1] = cmark_render_xml(doc, CMARK_OPT_DEFAULT);
+  expected[2] = cmark_render_man(doc, CMARK_OPT_DEFAULT, 20);
+  expected[3] = cmark_render_commonmark(doc, CMARK_OPT_DEFAULT, 20);
+  expected[4] = cmark_render_plaintext(doc, CMARK_OPT_DEFAULT, 0);
+  expected[5] = cmark_render_latex(doc, CMARK_OPT_DEFAULT, 0);
+
+  INT_EQ(runner, cmark_render_multi(doc, targets, 6), 1,
+         "cmark_render_multi succeeds");
+  for (i = 0; i < 6; ++i) {
+    STR_EQ(runner, targets[i].result, expected[i],
+           "cmark_render_multi output %d matches single render", i);
+    free(targets[i].result);
+    free(expected[i]);
+  }
+
+  targets[0].format = (cmark_format)42;
+  INT_EQ(runner, cmark_render_multi(doc, targets, 1), 0,
+         "cmark_render_multi rejects unknown formats");
+  OK(runner, targets[0].result == NULL, "no output for unknown formats");
+
+  cmark_node_free(doc);
+}
+
+static void shared_strings(test_batch_runner *runner) {
+  static const char markdown[] = "[a][r] [b][r] [c](/x \"t\") [d](/x \"t\")\n"
+                                 "\n"
+                                 "```python\n"
+                                 "```\n"
+                                 "``` python\n"
+                                 "```\n"
+                                 "\n"
+                                 "[r]: /r\n";
+  cmark_parser *parser = cmark_parser_new(CMARK_OPT_DEFAULT);
+  cmark_node *doc, *para, *a, *b, *c, *d, *code1, *code2;
+  char *html;
+
+  cmark_parser_feed(parser, markdown, sizeof(markdown) - 1);
+  doc = cmark_parser_finish(parser);
+  // The strings outlive the parser.
+  cmark_parser_free(parser);
+
+  para = cmark_node_first_child(doc);
+  a = cmark_node_first_child(para);
+  b = cmark_node_next(cmark_node_next(a));
+  c = cmark_node_next(cmark_node_next(b));
+  d = cmark_node_next(cmark_node_next(c));
+  code1 = cmark_node_next(para);
+  code2 = cmark_node_next(code1);
+
+  OK(runner, cmark_node_get_url(a) == cmark_node_get_url(b),
+     "links to a reference share its destination");
+  OK(runner, cmark_node_get_url(c) == cmark_node_get_url(d),
+     "equal inline link destinations are stored once");
+  OK(runner, cmark_node_get_title(c) == cmark_node_get_title(d),
+     "equal inline link titles are stored once");
+  OK(runner, cmark_node_get_fence_info(code1) ==
+                 cmark_node_get_fence_info(code2),
+     "equal info strings are stored once");
+
+  cmark_node_set_url(a, "/changed");
+  cmark_node_set_fence_info(code1, "c");
+  cmark_node_free(c);
+  html = cmark_render_html(doc, CMARK_OPT_DEFAULT, NULL);
+  STR_EQ(runner, html,
+         "<p><a href=\"/changed\">a</a> <a href=\"/r\">b</a>  "
+         "<a href=\"/x\" title=\"t\">d</a></p>\n"
+         "<pre><code class=\"language-c\"></code></pre>\n"
+         "<pre><code class=\"language-python\"></code></pre>\n",
+         "setting a shared string leaves the other nodes alone");
+  free(html);
+  cmark_node_free(doc);
+}
+
+static void render_html_batch(test_batch_runner *runner) {
+  static const char *const texts[] = {
+      "Release *notes* for `v1.2`", "", "a & b < c\n\nd", "[x]: /u\n[x]",
+      "~~gone~~ <b>bold</b>", "[x]",
+  };
+  size_t lens[6], offsets[6];
+  cmark_parser *parser;
+  cmark_node *doc;
+  char *result, *expected;
+  size_t i;
+
+  for (i = 0; i < 6; ++i)
+    lens[i] = strlen(texts[i]);
+
+  result = cmark_markdown_to_html_batch(texts, lens, 6, CMARK_OPT_DEFAULT,
+                                        offsets);
+  for (i = 0; i < 6; ++i) {
+    expected = cmark_markdown_to_html(texts[i], lens[i], CMARK_OPT_INLINE_ONLY);
+    STR_EQ(runner, result + offsets[i], expected,
+           "batch result %d matches cmark_markdown_to_html", (int)i);
+    free(expected);
+  }
+  free(result);
+
+  cmark_gfm_core_extensions_ensure_registered();
+  parser = cmark_parser_new(CMARK_OPT_INLINE_ONLY | CMARK_OPT_UNSAFE);
+  cmark_parser_attach_syntax_extension(
+      parser, cmark_find_syntax_extension("strikethrough"));
+  cmark_parser_attach_syntax_extension(parser,
+                                       cmark_find_syntax_extension("tagfilter"));
+  result = cmark_parser_render_html_batch(parser, texts + 3, lens + 3, 3,
+                                          offsets);
+  STR_EQ(runner, result + offsets[0], "<p><a href=\"/u\">x</a></p>\n",
+         "batch resolves references within a string");
+  STR_EQ(runner, result + offsets[1], "<p><del>gone</del> <b>bold</b></p>\n",
+         "batch renders with the parser's extensions");
+  STR_EQ(runner, result + offsets[2], "<p>[x]</p>\n",
+         "references don't carry over to the next string");
+  free(result);
+
+  cmark_parser_feed(parser, "*a*", 3);
+  doc = cmark_parser_finish(parser);
+  OK(runner, cmark_node_first_child(cmark_node_first_child(doc)) != NULL,
+     "parser is usable after a batch");
+  cmark_node_free(doc);
+  cmark_parser_free(parser);
+}
+
+static void finalize_footnotes(test_batch_runner *runner) {
+  static const char markdown[] = "a[^nope]b[^x]c[^nope]\n"
+                                 "\n"
+                                 "[^x]: d\n";
+  cmark_node *doc = cmark_parse_document(markdown, sizeof(markdown) - 1,
+                                         CMARK_OPT_FOOTNOTES);
+  cmark_node *para = cmark_node_first_child(doc);
+  cmark_node *node = cmark_node_first_child(para);
+
+  INT_EQ(runner, cmark_node_get_type(node), CMARK_NODE_TEXT,
+         "unresolved reference is text");
+  STR_EQ(runner, cmark_node_get_literal(node), "a[^nope]b",
+         "unresolved reference is merged with the preceding text");
+  node = cmark_node_next(node);
+  INT_EQ(runner, cmark_node_get_type(node), CMARK_NODE_FOOTNOTE_REFERENCE,
+         "resolved reference is kept");
+  STR_EQ(runner, cmark_node_get_literal(node), "x",
+         "resolved reference keeps its label");
+  INT_EQ(runner, cmark_node_get_footnote_ix(node), 1,
+         "resolved reference is numbered");
+  INT_EQ(runner, cmark_node_get_footnote_ix(cmark_node_parent_footnote_def(node)),
+         1, "definition is numbered");
+  node = cmark_node_next(node);
+  STR_EQ(runner, cmark_node_get_literal(node), "c[^nope]",
+         "unresolved reference is merged with the following text");
+  OK(runner, cmark_node_next(node) == NULL, "text is consolidated");
+  INT_EQ(runner, cmark_node_get_type(cmark_node_last_child(doc)),
+         CMARK_NODE_FOOTNOTE_DEFINITION, "definition is moved to the end");
+
+  cmark_node_free(doc);
+}
+
+static void tagfilter_classification(test_batch_runner *runner) {
+  static const char markdown[] = "<div>\n<xmp>\n</div>\n"
+                                 "\n"
+                                 "<em>a</em>\n";
+  cmark_gfm_core_extensions_ensure_registered();
+  cmark_parser *parser = cmark_parser_new(CMARK_OPT_UNSAFE);
+  cmark_parser_attach_syntax_extension(parser,
+                                       cmark_find_syntax_extension("tagfilter"));
+  cmark_parser_feed(parser, markdown, sizeof(markdown) - 1);
+  cmark_node *doc = cmark_parser_finish(parser);
+  cmark_llist *exts = cmark_parser_get_syntax_extensions(parser);
+
+  cmark_node *block = cmark_node_first_child(doc);
+  cmark_node *em = cmark_node_first_child(cmark_node_next(block));
+  OK(runner, !(block->flags & CMARK_NODE__HTML_UNFILTERED),
+     "HTML block with a filtered tag is classified as such");
+  OK(runner, em->flags & CMARK_NODE__HTML_UNFILTERED,
+     "inline HTML without filtered tags is classified as such");
+
+  char *html = cmark_render_html(doc, CMARK_OPT_UNSAFE, exts);
+  STR_EQ(runner, html,
+         "<div>\n&lt;xmp>\n</div>\n<p><em>a</em></p>\n",
+         "classified HTML renders filtered");
+  free(html);
+
+  cmark_node_set_literal(em, "<script>");
+  OK(runner, !(em->flags & CMARK_NODE__HTML_UNFILTERED),
+     "setting the literal drops the classification");
+  html = cmark_render_html(doc, CMARK_OPT_UNSAFE, exts);
+  STR_EQ(runner, html,
+         "<div>\n&lt;xmp>\n</div>\n<p>&lt;script>a</em></p>\n",
+         "new literal is filtered");
+  free(html);
+
+  cmark_node_free(doc);
+  cmark_parser_free(parser);
+}
+
+static void reference_labels(test_batch_runner *runner) {
+  char label[1024], buf[2 * sizeof(label) + 16];
+  char *html;
+  int i;
+
+  test_md_to_html(runner, "[\xE1\xBA\x9E Stra\xC3\x9F""e \t\n FOO]: /a\n\n"
+                          "[ss  STRASSE foo]\n",
+                  "<p><a href=\"/a\">ss  STRASSE foo</a></p>\n",
+                  "labels are case folded and whitespace collapsed");
+  test_md_to_html(runner, "[\xCE\xA3\xCE\xB1\xCF\x82]: /b\n\n[\xCF\x83\xCE\x91\xCE\xA3]\n",
+                  "<p><a href=\"/b\">\xCF\x83\xCE\x91\xCE\xA3</a></p>\n",
+                  "non-ASCII labels are case folded");
+
+  // Each U+0390 folds to three code points, tripling the label's length.
+  strcpy(label, "[");
+  for (i = 0; i < 450; i++)
+    strcat(label, "\xCE\x90");
+  strcat(label, "]");
+  snprintf(buf, sizeof(buf), "%s: /c\n\nx %s\n", label, label);
+  html = cmark_markdown_to_html(buf, strlen(buf), CMARK_OPT_DEFAULT);
+  OK(runner, strstr(html, "<a href=\"/c\">") != NULL,
+     "label that expands when folded");
+  free(html);
+}
+
+static int open_block_calls;
+
+static cmark_node *count_open_block(cmark_syntax_extension *self, int indented,
+                                   cmark_parser *parser,
+                                   cmark_node *parent_container,
+                                   unsigned char *input, int len) {
+  open_block_calls++;
+  return NULL;
+}
+
+static void block_start_chars(test_batch_runner *runner) {
+  static const char markdown[] = "a\n!b\n  !c\n> !d\n# e\n";
+  cmark_syntax_extension *ext = cmark_syntax_extension_new("starts");
+  cmark_parser *parser;
+  cmark_node *doc;
+
+  cmark_syntax_extension_set_open_block_func(ext, count_open_block);
+
+  open_block_calls = 0;
+  parser = cmark_parser_new(CMARK_OPT_DEFAULT);
+  cmark_parser_attach_syntax_extension(parser, ext);
+  cmark_parser_feed(parser, markdown, sizeof(markdown) - 1);
+  doc = cmark_parser_finish(parser);
+  INT_EQ(runner, open_block_calls, 4,
+         "without start chars, every line not opening a core block");
+  cmark_node_free(doc);
+  cmark_parser_free(parser);
+
+  cmark_syntax_extension_set_block_start_chars(
+      ext, cmark_llist_append(cmark_get_default_mem_allocator(), NULL,
+                              (void *)'!'));
+
+  open_block_calls = 0;
+  parser = cmark_parser_new(CMARK_OPT_DEFAULT);
+  cmark_parser_attach_syntax_extension(parser, ext);
+  cmark_parser_feed(parser, markdown, sizeof(markdown) - 1);
+  doc = cmark_parser_finish(parser);
+  INT_EQ(runner, open_block_calls, 3,
+         "with start chars, only lines starting with one of them");
+  cmark_node_free(doc);
+  cmark_parser_free(parser);
+
+  cmark_syntax_extension_free(cmark_get_default_mem_allocator(), ext);
+}
+
+static cmark_syntax_extension *first_inline_ext;
+static int inline_calls[2];
+
+static cmark_node *count_match_inline(cmark_syntax_extension *self,
+                                      cmark_parser *parser, cmark_node *parent,
+                                      unsigned char character,
+                                      cmark_inline_parser *inline_parser) {
+  inline_calls[self == first_inline_ext ? 0 : 1]++;
+  return NULL;
+}
+
+static void inline_special_chars(test_batch_runner *runner) {
+  static const char markdown[] = "a % b $ c %\n";
+  cmark_mem *mem = cmark_get_default_mem_allocator();
+  cmark_syntax_extension *first = cmark_syntax_extension_new("first");
+  cmark_syntax_extension *second = cmark_syntax_extension_new("second");
+  cmark_parser *parser;
+  cmark_node *doc;
+  char *html;
+
+  cmark_syntax_extension_set_match_inline_func(first, count_match_inline);
+  cmark_syntax_extension_set_special_inline_chars(
+      first, cmark_llist_append(mem, cmark_llist_append(mem, NULL, (void *)'%'),
+                                (void *)'$'));
+  cmark_syntax_extension_set_match_inline_func(second, count_match_inline);
+  cmark_syntax_extension_set_special_inline_chars(
+      second, cmark_llist_append(mem, NULL, (void *)'%'));
+  first_inline_ext = first;
+
+  parser = cmark_parser_new(CMARK_OPT_DEFAULT);
+  cmark_parser_attach_syntax_extension(parser, first);
+  cmark_parser_attach_syntax_extension(parser, second);
+  cmark_parser_feed(parser, markdown, sizeof(markdown) - 1);
+  doc = cmark_parser_finish(parser);
+  INT_EQ(runner, inline_calls[0], 3, "first extension gets its characters");
+  INT_EQ(runner, inline_calls[1], 2,
+         "second extension gets its characters the first one passes on");
+  html = cmark_render_html(doc, CMARK_OPT_DEFAULT, NULL);
+  STR_EQ(runner, html, "<p>a % b $ c %</p>\n",
+         "unmatched special characters stay text");
+  free(html);
+  cmark_node_free(doc);
+  cmark_parser_free(parser);
+
+  cmark_syntax_extension_free(mem, first);
+  cmark_syntax_extension_free(mem, second);
+}
+
 int main() {
   int retval;
   test_batch_runner *runner = test_batch_runner_new();
@@ -1600,6 +2455,9 @@ int main() {
   test_safe(runner);
   test_feed_across_line_ending(runner);
   test_pathological_regressions(runner);
+  blank_lines_in_nested_blocks(runner);
+  fenced_code_lines(runner);
+  html_block_lines(runner);
   source_pos(runner);
   source_pos_inlines(runner);
   ref_source_pos(runner);
@@ -1609,6 +2467,21 @@ int main() {
   verify_custom_attributes_node_with_footnote(runner);
   parser_interrupt(runner);
   table_spans(runner);
+  render_capacity(runner);
+  lazy_inlines(runner);
+  serialize_roundtrip(runner);
+  deserialize_corrupted(runner);
+  deserialize_out_of_range(runner);
+  render_multi(runner);
+  render_html_batch(runner);
+  shared_strings(runner);
+  finalize_footnotes(runner);
+  tagfilter_classification(runner);
+  reference_labels(runner);
+  parser_cancel(runner);
+  accounting_mem(runner);
+  block_start_chars(runner);
+  inline_special_chars(runner);
 
   test_print_summary(runner);
   retval = test_ok(runner) ? 0 : 1;
@@ -0,0 +1,278 @@
+/* Complexity regression benchmark.
+ *
+ * Generates each pathological pattern at sizes from 1 kB up to a maximum
+ * (10 MB by default), times parsing and rendering it to HTML in-process,
+ * and fits the exponent of the growth of the time with the input size as
+ * the median of the slopes between the sizes on a log-log scale, so that
+ * one noisy size or the step at which the input outgrows the caches does
+ * not decide it.  Each size is timed several times and the fastest time is
+ * kept.  Exits with a non-zero status when a pattern grows faster than the
+ * maximum exponent, which leaves room for O(n log n) and for cache effects
+ * at the larger sizes, but not for O(n^1.5) or worse, or when a pattern is
+ * too fast at the maximum size to fit at all.
+ *
+ * Usage: complexity [--max-size BYTES] [--max-exponent E] [PATTERN...]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cmark-gfm.h"
+#include "cmark-gfm-core-extensions.h"
+
+#define MIN_SIZE 1000
+#define DEFAULT_MAX_SIZE 10000000
+#define DEFAULT_MAX_EXPONENT 1.4
+
+/* Times below this many seconds are dominated by setting up the parser
+ * rather than by the input, and are not fitted. */
+#define MIN_FIT_TIME 0.0005
+/* A sample repeats the run for at least this many seconds, and a size is
+ * sampled up to MAX_SAMPLES times while its samples take less than
+ * MAX_SAMPLING_TIME seconds in total. */
+#define MIN_SAMPLE_TIME 0.01
+#define MAX_SAMPLES 5
+#define MAX_SAMPLING_TIME 1.0
+/* The sizes of a pattern stop growing after a run of this many seconds: it
+ * is slow enough to fail the fit. */
+#define MAX_RUN_TIME 10.0
+/* The number of sizes from 1 kB up to the largest size_t. */
+#define MAX_SIZES 20
+
+/* The document is 'open' repeated, then 'middle', then 'close' repeated
+ * as often as 'open', up to the requested size.  With an empty 'open',
+ * 'close' is repeated up to the size instead.  With 'wrap', a line break
+ * and 'middle' again follow every 'wrap' repetitions of 'close', for
+ * patterns within a line that the parser only takes up to a length.  It
+ * is parsed with 'options' on top of the common ones. */
+typedef struct {
+  const char *name;
+  const char *open;
+  const char *middle;
+  const char *close;
+  int options;
+  size_t wrap;
+} pattern;
+
+static const pattern patterns[] = {
+    {"nested brackets", "[", "a", "]", 0, 0},
+    {"link openers and closers", "[ (](", "", "", 0, 0},
+    {"image openers", "![[]()", "", "", 0, 0},
+    {"unclosed links", "[a](<b", "", "", 0, 0},
+    {"attribute openers", "^[a", "", "", 0, 0},
+    {"unclosed attributes", "^[a](", "", "", 0, 0},
+    {"processing instructions", "<?x", "", "", 0, 0},
+    {"unclosed comments", "<!--", "", "", 0, 0},
+    {"nested block quotes", "> ", "a", "", 0, 0},
+    {"nested emphasis", "*a **a ", "b", " a** a*", 0, 0},
+    {"emph closers without openers", "a_ ", "", "", 0, 0},
+    {"emph openers without closers", "_a ", "", "", 0, 0},
+    {"mismatched delimiters", "*a_ ", "", "", 0, 0},
+    {"strikethrough delimiters", "~~a ~", "", "", 0, 0},
+    {"table rows", "aaa\rbbb\n-\v\n", "", "", 0, 0},
+    {"short table rows", "", "|a|b|c|d|e|f|g|h|\n|-|-|-|-|-|-|-|-|\n", "|x\n", 0, 0},
+    /* A table row has fewer than 65535 cells. */
+    {"table colspan chains", "", "|a|\n|-|\n|a", "|", CMARK_OPT_TABLE_SPANS,
+     60000},
+    {"table rowspan chains", "", "|a|\n|-|\n|b|\n", "|^|\n",
+     CMARK_OPT_TABLE_SPANS, 0},
+    {"table ditto rowspan chains", "", "|a|\n|-|\n|b|\n", "|\"|\n",
+     CMARK_OPT_TABLE_SPANS | CMARK_OPT_TABLE_ROWSPAN_DITTO, 0},
+};
+
+#define NUM_PATTERNS (sizeof(patterns) / sizeof(patterns[0]))
+
+static const char *extension_names[] = {
+    "autolink", "strikethrough", "table", "tagfilter", NULL,
+};
+
+static const int common_options = CMARK_OPT_UNSAFE | CMARK_OPT_FOOTNOTES |
+                           CMARK_OPT_GITHUB_PRE_LANG | CMARK_OPT_HARDBREAKS;
+
+static char *generate(const pattern *p, size_t size, size_t *len) {
+  size_t open_len = strlen(p->open), middle_len = strlen(p->middle),
+         close_len = strlen(p->close);
+  size_t count = (size - middle_len) / (open_len + close_len);
+  size_t wraps = p->wrap ? count / p->wrap : 0;
+  char *doc = (char *)malloc(count * (open_len + close_len) + middle_len +
+                             wraps * (middle_len + 1) + 1);
+  char *q = doc;
+  size_t i;
+
+  for (i = 0; i < count; i++, q += open_len)
+    memcpy(q, p->open, open_len);
+  memcpy(q, p->middle, middle_len);
+  q += middle_len;
+  for (i = 0; i < count; i++, q += close_len) {
+    if (p->wrap && i && i % p->wrap == 0) {
+      *q++ = '\n';
+      memcpy(q, p->middle, middle_len);
+      q += middle_len;
+    }
+    memcpy(q, p->close, close_len);
+  }
+  *q = '\0';
+
+  *len = q - doc;
+  return doc;
+}
+
+static void parse_and_render(const char *doc, size_t len, int options) {
+  cmark_parser *parser = cmark_parser_new(options);
+  const char **name;
+  cmark_node *root;
+  char *html;
+
+  for (name = extension_names; *name; name++)
+    cmark_parser_attach_syntax_extension(parser,
+                                         cmark_find_syntax_extension(*name));
+
+  cmark_parser_feed(parser, doc, len);
+  root = cmark_parser_finish(parser);
+  html = cmark_render_html(root, options, cmark_parser_get_syntax_extensions(parser));
+
+  free(html);
+  cmark_node_free(root);
+  cmark_parser_free(parser);
+}
+
+/* Return the time of one parse and render of 'doc', in seconds: the
+ * fastest of several samples, each averaged over enough runs to be well
+ * above the resolution of the clock. */
+static double time_run(const char *doc, size_t len, int options) {
+  clock_t first = clock();
+  double best = 0;
+  int samples;
+
+  for (samples = 0; samples < MAX_SAMPLES; samples++) {
+    clock_t start = clock(), end;
+    int runs = 0;
+    double t;
+
+    do {
+      parse_and_render(doc, len, options);
+      runs++;
+      end = clock();
+    } while ((double)(end - start) / CLOCKS_PER_SEC < MIN_SAMPLE_TIME);
+
+    t = (double)(end - start) / CLOCKS_PER_SEC / runs;
+    if (samples == 0 || t < best)
+      best = t;
+    if ((double)(end - first) / CLOCKS_PER_SEC >= MAX_SAMPLING_TIME)
+      break;
+  }
+
+  return best;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+/* Time 'p' at each size and return the fitted exponent, or a negative
+ * value if too few sizes took long enough to fit. */
+static double measure(const pattern *p, size_t max_size) {
+  double x[MAX_SIZES], y[MAX_SIZES];
+  double slopes[MAX_SIZES * (MAX_SIZES - 1) / 2];
+  int n = 0, n_slopes = 0, i, j;
+  size_t size;
+
+  printf("%-30s", p->name);
+  fflush(stdout);
+
+  for (size = MIN_SIZE; size <= max_size; size *= 10) {
+    size_t len;
+    char *doc = generate(p, size, &len);
+    double t = time_run(doc, len, common_options | p->options);
+
+    free(doc);
+    printf(" %9.4f", t);
+    fflush(stdout);
+
+    if (t >= MIN_FIT_TIME) {
+      x[n] = log((double)len);
+      y[n] = log(t);
+      n++;
+    }
+    if (t >= MAX_RUN_TIME || size > (size_t)-1 / 10)
+      break;
+  }
+
+  if (n < 2)
+    return -1;
+  for (i = 0; i < n; i++)
+    for (j = i + 1; j < n; j++)
+      slopes[n_slopes++] = (y[j] - y[i]) / (x[j] - x[i]);
+  qsort(slopes, n_slopes, sizeof(*slopes), compare_doubles);
+  if (n_slopes % 2)
+    return slopes[n_slopes / 2];
+  return (slopes[n_slopes / 2 - 1] + slopes[n_slopes / 2]) / 2;
+}
+
+int main(int argc, char **argv) {
+  size_t max_size = DEFAULT_MAX_SIZE;
+  double max_exponent = DEFAULT_MAX_EXPONENT;
+  int selected = 0, failed = 0, unfitted = 0;
+  size_t i, size;
+  int j;
+
+  for (j = 1; j < argc; j++) {
+    if (strcmp(argv[j], "--max-size") == 0 && j + 1 < argc) {
+      max_size = (size_t)strtoul(argv[++j], NULL, 10);
+    } else if (strcmp(argv[j], "--max-exponent") == 0 && j + 1 < argc) {
+      max_exponent = strtod(argv[++j], NULL);
+    } else if (argv[j][0] == '-') {
+      fprintf(stderr,
+              "Usage: %s [--max-size BYTES] [--max-exponent E] [PATTERN...]\n",
+              argv[0]);
+      return 2;
+    } else {
+      selected++;
+    }
+  }
+
+  cmark_gfm_core_extensions_ensure_registered();
+
+  printf("%-30s", "seconds per parse and render");
+  for (size = MIN_SIZE; size <= max_size; size *= 10)
+    printf(" %9lu", (unsigned long)size);
+  printf("  exponent\n");
+
+  for (i = 0; i < NUM_PATTERNS; i++) {
+    const pattern *p = &patterns[i];
+    double exponent;
+
+    if (selected) {
+      for (j = 1; j < argc; j++) {
+        if (strcmp(argv[j], "--max-size") == 0 ||
+            strcmp(argv[j], "--max-exponent") == 0)
+          j++;
+        else if (strcmp(argv[j], p->name) == 0)
+          break;
+      }
+      if (j == argc)
+        continue;
+    }
+
+    exponent = measure(p, max_size);
+    if (exponent < 0) {
+      printf("  too fast to fit FAILED\n");
+      unfitted++;
+    } else if (exponent > max_exponent) {
+      printf("  %.2f FAILED\n", exponent);
+      failed++;
+    } else {
+      printf("  %.2f\n", exponent);
+    }
+  }
+
+  if (failed)
+    printf("%d pattern(s) grow faster than n^%.2f\n", failed, max_exponent);
+  if (unfitted)
+    printf("%d pattern(s) are too fast to fit: raise --max-size\n", unfitted);
+  return failed || unfitted ? 1 : 0;
+}
@@ -0,0 +1,136 @@
+/* Multi-threaded table parsing benchmark.
+ *
+ * Parses a document of tables, and of paragraphs that look like the start
+ * of one until their delimiter row, in 1, 2, 4, ... threads up to the
+ * number of processors, each thread with its own parser, and prints the
+ * throughput and the speedup over one thread.  Parsers share no state, so
+ * the speedup should grow linearly with the number of threads up to the
+ * number of cores.  Past that the threads share the cores, and a steady
+ * total throughput shows that they do not slow each other down.
+ *
+ * Usage: tables [--threads N] [--iterations N]
+ */
+
+// For clock_gettime and sysconf.
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cmark-gfm.h"
+#include "cmark-gfm-core-extensions.h"
+
+#define NUM_TABLES 2000
+#define DEFAULT_ITERATIONS 20
+
+static const char table[] =
+    "| Name | Type | Default | Description |\n"
+    "|:-----|:----:|--------:|-------------|\n"
+    "| `width` | int | 80 | Wrap *rendered* lines at this column |\n"
+    "| `safe` | bool | true | Strip raw HTML and [unsafe](links) |\n"
+    "| `smart` | bool | false | Use ~~straight~~ curly quotes |\n"
+    "\n"
+    "a | b | c\n"
+    "--- | ---\n"
+    "\n";
+
+static char *doc;
+static size_t doc_len;
+static int iterations = DEFAULT_ITERATIONS;
+
+static void *parse(void *arg) {
+  cmark_syntax_extension *ext = cmark_find_syntax_extension("table");
+  int i;
+
+  (void)arg;
+  for (i = 0; i < iterations; i++) {
+    cmark_parser *parser = cmark_parser_new(CMARK_OPT_DEFAULT);
+    cmark_node *root;
+
+    cmark_parser_attach_syntax_extension(parser, ext);
+    cmark_parser_feed(parser, doc, doc_len);
+    root = cmark_parser_finish(parser);
+    cmark_node_free(root);
+    cmark_parser_free(parser);
+  }
+  return NULL;
+}
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Return the wall-clock time of every thread parsing the document. */
+static double time_threads(int n_threads) {
+  pthread_t *threads = (pthread_t *)malloc(n_threads * sizeof(pthread_t));
+  double start = now(), end;
+  int i;
+
+  for (i = 0; i < n_threads; i++) {
+    if (pthread_create(&threads[i], NULL, parse, NULL) != 0) {
+      fprintf(stderr, "pthread_create failed\n");
+      exit(1);
+    }
+  }
+  for (i = 0; i < n_threads; i++)
+    pthread_join(threads[i], NULL);
+  end = now();
+
+  free(threads);
+  return end - start;
+}
+
+int main(int argc, char **argv) {
+  long max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  double base = 0, t, mbs;
+  int i, n;
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      max_threads = strtol(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = (int)strtol(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr, "Usage: %s [--threads N] [--iterations N]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (max_threads < 1)
+    max_threads = 1;
+
+  cmark_gfm_core_extensions_ensure_registered();
+
+  doc_len = (sizeof(table) - 1) * NUM_TABLES;
+  doc = (char *)malloc(doc_len);
+  for (i = 0; i < NUM_TABLES; i++)
+    memcpy(doc + i * (sizeof(table) - 1), table, sizeof(table) - 1);
+
+  printf("%7s %10s %10s %8s %10s\n", "threads", "seconds", "MB/s", "speedup",
+         "efficiency");
+  for (n = 1;; n *= 2) {
+    if (n > max_threads)
+      n = (int)max_threads;
+
+    t = time_threads(n);
+    mbs = (double)doc_len * iterations * n / t / 1e6;
+
+    if (n == 1)
+      base = mbs;
+    printf("%7d %10.3f %10.1f %8.2f %9.0f%%\n", n, t, mbs, mbs / base,
+           100 * mbs / base / n);
+    fflush(stdout);
+
+    if (n == max_threads)
+      break;
+  }
+
+  free(doc);
+  return 0;
+}
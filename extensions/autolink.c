@@ -4,6 +4,7 @@
 
 #include "autolink.h"
 #include <parser.h>
+#include <iterator.h>
 #include <utf8.h>
 
 #if defined(_WIN32)
@@ -462,16 +463,16 @@ found_at:
 }
 
 static cmark_node *postprocess(cmark_syntax_extension *ext, cmark_parser *parser, cmark_node *root) {
-  cmark_iter *iter;
+  cmark_iter iter;
   cmark_event_type ev;
   cmark_node *node;
   bool in_link = false;
 
   cmark_consolidate_text_nodes(root);
-  iter = cmark_iter_new(root);
+  cmark_iter_init(&iter, root);
 
-  while ((ev = cmark_iter_next(iter)) != CMARK_EVENT_DONE) {
-    node = cmark_iter_get_node(iter);
+  while ((ev = cmark_iter_next(&iter)) != CMARK_EVENT_DONE) {
+    node = cmark_iter_get_node(&iter);
     if (in_link) {
       if (ev == CMARK_EVENT_EXIT && node->type == CMARK_NODE_LINK) {
         in_link = false;
@@ -489,8 +490,6 @@ static cmark_node *postprocess(cmark_syntax_extension *ext, cmark_parser *parser
     }
   }
 
-  cmark_iter_free(iter);
-
   return root;
 }
 
@@ -25,6 +25,8 @@ cmark_node_type CMARK_NODE_TABLE, CMARK_NODE_TABLE_ROW,
 typedef struct {
   unsigned colspan, rowspan;
   int cell_index;
+  // For a rowspan marker, the cell it spans with, while the table is parsed
+  cmark_node *rowspan_cell;
 } node_cell_data;
 
 typedef struct {
@@ -259,6 +261,64 @@ static node_cell* append_row_cell(cmark_mem *mem, table_row *row) {
   return &row->cells[n_columns-1];
 }
 
+// Returns the number of cells in the row `row_from_string` would parse from
+// `string`, or 0 if it would not find a row, without allocating anything.
+// The offset of the row in `string` is stored in `paragraph_offset`.
+static uint16_t count_row_cells(const unsigned char *string, int len,
+                                int *paragraph_offset) {
+  bufsize_t cell_matched, pipe_matched, row_end_offset, offset;
+  int expect_more_cells = 1;
+  uint32_t n_columns = 0;
+
+  *paragraph_offset = 0;
+  offset = scan_table_cell_end((unsigned char *)string, len, 0);
+
+  while (offset < len && expect_more_cells) {
+    cell_matched = scan_table_cell((unsigned char *)string, len, offset);
+    pipe_matched = scan_table_cell_end((unsigned char *)string, len,
+                                       offset + cell_matched);
+
+    if ((cell_matched || pipe_matched) && ++n_columns == UINT16_MAX)
+      return 0;
+
+    offset += cell_matched + pipe_matched;
+
+    if (pipe_matched) {
+      expect_more_cells = 1;
+    } else {
+      row_end_offset = scan_table_row_end((unsigned char *)string, len, offset);
+      offset += row_end_offset;
+
+      if (row_end_offset && offset != len) {
+        *paragraph_offset = offset;
+        n_columns = 0;
+        offset += scan_table_cell_end((unsigned char *)string, len, offset);
+        expect_more_cells = 1;
+      } else {
+        expect_more_cells = 0;
+      }
+    }
+  }
+
+  if (offset != len)
+    return 0;
+  return (uint16_t)n_columns;
+}
+
+// Returns whether the last line of `string`, a paragraph's content, has a
+// pipe in it.
+static bool last_line_has_pipe(const unsigned char *string, int len) {
+  int start = len;
+
+  // Skip the line ending of the last line.
+  while (start > 0 && (string[start - 1] == '\n' || string[start - 1] == '\r'))
+    start--;
+  len = start;
+  while (start > 0 && string[start - 1] != '\n' && string[start - 1] != '\r')
+    start--;
+  return memchr(string + start, '|', len - start) != NULL;
+}
+
 static table_row *row_from_string(cmark_syntax_extension *self,
                                   cmark_parser *parser, unsigned char *string,
                                   int len) {
@@ -278,6 +338,8 @@ static table_row *row_from_string(cmark_syntax_extension *self,
   int expect_more_cells = 1;
   int row_end_offset = 0;
   int int_overflow_abort = 0;
+  // The index of the last cell that starts a column span, if any
+  int colspan_cell = -1;
 
   row = (table_row *)parser->mem->calloc(1, sizeof(table_row));
   row->n_columns = 0;
@@ -326,17 +388,12 @@ static table_row *row_from_string(cmark_syntax_extension *self,
         if (row->n_columns > 0 && cmark_strbuf_len(cell->buf) == 0 && cell->start_offset == cell->end_offset) {
           cell->cell_data->colspan = 0;
 
-          // find the last cell that isn't part of a colspan, and increment that colspan
-          node_cell *colspan_cell = NULL;
-          for (uint16_t i = 0; i < row->n_columns; i++) {
-            node_cell *this_cell = &row->cells[i];
-            if (this_cell->cell_data->colspan > 0)
-              colspan_cell = this_cell;
-          }
-          if (colspan_cell)
-            ++colspan_cell->cell_data->colspan;
+          // increment the colspan of the last cell that isn't part of one
+          if (colspan_cell >= 0)
+            ++row->cells[colspan_cell].cell_data->colspan;
         } else {
           cell->cell_data->colspan = 1;
+          colspan_cell = row->n_columns - 1;
         }
 
         // Check this cell for a row-span marker, so that the spanning cell's rowspan can be incremented later.
@@ -379,6 +436,7 @@ static table_row *row_from_string(cmark_syntax_extension *self,
         row->paragraph_offset = offset;
 
         free_row_cells(parser->mem, row);
+        colspan_cell = -1;
 
         // Scan past the (optional) leading pipe.
         offset += scan_table_cell_end(string, len, offset);
@@ -427,57 +485,56 @@ static cmark_node *try_opening_table_header(cmark_syntax_extension *self,
   table_row *delimiter_row = NULL;
   node_table_row *ntr;
   const char *parent_string;
-  uint16_t i;
+  int parent_len, first_nonspace, paragraph_offset;
+  uint16_t n_columns, i;
 
   if (parent_container->flags & CMARK_NODE__TABLE_VISITED) {
     return parent_container;
   }
 
-  if (!scan_table_start(input, len, cmark_parser_get_first_nonspace(parser))) {
+  first_nonspace = cmark_parser_get_first_nonspace(parser);
+  if (!scan_table_start(input, len, first_nonspace)) {
     return parent_container;
   }
 
-  // Since scan_table_start was successful, we must have a delimiter row.
-  delimiter_row = row_from_string(
-    self, parser, input + cmark_parser_get_first_nonspace(parser),
-    len - cmark_parser_get_first_nonspace(parser));
-  // assert may be optimized out, don't rely on it for security boundaries
-  if (!delimiter_row) {
-      return parent_container;
+  // Check for a delimiter row and a matching header row before building
+  // either, so that a paragraph which turns out not to be a table header
+  // costs no allocations. The header row is looked for in the entire
+  // (potentially long) parent container, but `count_row_cells` bails out
+  // early if it does not find a row.
+  parent_string = cmark_node_get_string_content(parent_container);
+  parent_len = parent_container->content.size;
+  n_columns = count_row_cells(input + first_nonspace, len - first_nonspace,
+                              &paragraph_offset);
+  // The header row is the last line of the paragraph, and has a single
+  // cell unless it has a pipe, which is found without going through the
+  // lines before it.
+  if (n_columns > 1 &&
+      !last_line_has_pipe((const unsigned char *)parent_string, parent_len)) {
+    parent_container->flags |= CMARK_NODE__TABLE_VISITED;
+    return parent_container;
+  }
+  if (!n_columns ||
+      count_row_cells((const unsigned char *)parent_string, parent_len,
+                      &paragraph_offset) != n_columns) {
+    parent_container->flags |= CMARK_NODE__TABLE_VISITED;
+    return parent_container;
   }
 
-  assert(delimiter_row);
-
-  cmark_arena_push();
-
-  // Check for a matching header row. We call `row_from_string` with the entire
-  // (potentially long) parent container as input, but this should be safe since
-  // `row_from_string` bails out early if it does not find a row.
-  parent_string = cmark_node_get_string_content(parent_container);
+  delimiter_row = row_from_string(self, parser, input + first_nonspace,
+                                  len - first_nonspace);
   header_row = row_from_string(self, parser, (unsigned char *)parent_string,
-                               (int)strlen(parent_string));
-  if (!header_row || header_row->n_columns != delimiter_row->n_columns) {
+                               parent_len);
+  // `count_row_cells` accepts exactly the rows `row_from_string` does, but
+  // don't rely on that for security boundaries.
+  if (!delimiter_row || !header_row ||
+      header_row->n_columns != delimiter_row->n_columns) {
     free_table_row(parser->mem, delimiter_row);
     free_table_row(parser->mem, header_row);
-    cmark_arena_pop();
     parent_container->flags |= CMARK_NODE__TABLE_VISITED;
     return parent_container;
   }
 
-  if (cmark_arena_pop()) {
-    delimiter_row = row_from_string(
-        self, parser, input + cmark_parser_get_first_nonspace(parser),
-        len - cmark_parser_get_first_nonspace(parser));
-    header_row = row_from_string(self, parser, (unsigned char *)parent_string,
-                                 (int)strlen(parent_string));
-    // row_from_string can return NULL, add additional check to ensure n_columns match
-    if (!delimiter_row || !header_row || header_row->n_columns != delimiter_row->n_columns) {
-        free_table_row(parser->mem, delimiter_row);
-        free_table_row(parser->mem, header_row);
-        return parent_container;
-    }
-  }
-
   if (!cmark_node_set_type(parent_container, CMARK_NODE_TABLE)) {
     free_table_row(parser->mem, header_row);
     free_table_row(parser->mem, delimiter_row);
@@ -514,7 +571,7 @@ static cmark_node *try_opening_table_header(cmark_syntax_extension *self,
       cmark_parser_add_child(parser, parent_container, CMARK_NODE_TABLE_ROW,
                              parent_container->start_column);
   cmark_node_set_syntax_extension(table_header, self);
-  table_header->end_column = parent_container->start_column + (int)strlen(parent_string) - 2;
+  table_header->end_column = parent_container->start_column + parent_len - 2;
   table_header->start_line = table_header->end_line = parent_container->start_line;
 
   table_header->as.opaque = ntr = (node_table_row *)parser->mem->calloc(1, sizeof(node_table_row));
@@ -536,9 +593,8 @@ static cmark_node *try_opening_table_header(cmark_syntax_extension *self,
 
   incr_table_row_count(parent_container, i);
 
-  cmark_parser_advance_offset(
-      parser, (char *)input,
-      (int)strlen((char *)input) - 1 - cmark_parser_get_offset(parser), false);
+  cmark_parser_advance_offset(parser, (char *)input,
+                              len - 1 - cmark_parser_get_offset(parser), false);
 
   free_table_row(parser->mem, header_row);
   free_table_row(parser->mem, delimiter_row);
@@ -579,23 +635,20 @@ static cmark_node *try_opening_table_row(cmark_syntax_extension *self,
 
   if (parser->options & CMARK_OPT_TABLE_SPANS) {
     // Check the new row for rowspan markers and increment the rowspan of the cell it's merging with
+    cmark_node *above = table_row_block->prev ? table_row_block->prev->first_child : NULL;
     int i;
 
-    for (i = 0; i < row->n_columns && i < table_columns; ++i) {
+    for (i = 0; i < row->n_columns && i < table_columns;
+         ++i, above = above ? above->next : NULL) {
       node_cell *this_cell = &row->cells[i];
       if (this_cell->cell_data->rowspan == 0) {
-        // Rowspan marker. Scan up through previous rows and increment the spanning cell's rowspan
-        cmark_node *check_row = table_row_block->prev;
-        cmark_node *spanning_cell = NULL;
-        while (check_row && !spanning_cell) {
-          cmark_node *check_cell = cmark_node_nth_child(check_row, i);
-          unsigned check_rowspan = get_cell_rowspan(check_cell);
-          if (check_rowspan == 0) {
-            check_row = check_row->prev;
-          } else {
-            spanning_cell = check_cell;
-          }
-        }
+        // Rowspan marker. The spanning cell is the cell above it, or the one
+        // a marker above it spans with, so chains of markers are not
+        // scanned again for each row.
+        cmark_node *spanning_cell = above;
+        if (get_cell_rowspan(above) == 0)
+          spanning_cell = ((node_cell_data *)above->as.opaque)->rowspan_cell;
+        this_cell->cell_data->rowspan_cell = spanning_cell;
         if (spanning_cell) {
           increment_cell_rowspan(spanning_cell);
           // The rowspan marker cell still has the ^/" marker, clear it out so it won't display
@@ -657,20 +710,14 @@ static cmark_node *try_opening_table_block(cmark_syntax_extension *self,
 static int matches(cmark_syntax_extension *self, cmark_parser *parser,
                    unsigned char *input, int len,
                    cmark_node *parent_container) {
-  int res = 0;
-
-  if (cmark_node_get_type(parent_container) == CMARK_NODE_TABLE) {
-    cmark_arena_push();
-    table_row *new_row = row_from_string(
-        self, parser, input + cmark_parser_get_first_nonspace(parser),
-        len - cmark_parser_get_first_nonspace(parser));
-    if (new_row && new_row->n_columns)
-      res = 1;
-    free_table_row(parser->mem, new_row);
-    cmark_arena_pop();
-  }
+  int first_nonspace, paragraph_offset;
 
-  return res;
+  if (cmark_node_get_type(parent_container) != CMARK_NODE_TABLE)
+    return 0;
+
+  first_nonspace = cmark_parser_get_first_nonspace(parser);
+  return count_row_cells(input + first_nonspace, len - first_nonspace,
+                         &paragraph_offset) != 0;
 }
 
 static const char *get_type_string(cmark_syntax_extension *self,
@@ -1050,6 +1097,115 @@ static void opaque_free(cmark_syntax_extension *self, cmark_mem *mem, cmark_node
   }
 }
 
+static void put_u32(unsigned char *p, uint32_t value) {
+  p[0] = (unsigned char)(value & 0xff);
+  p[1] = (unsigned char)((value >> 8) & 0xff);
+  p[2] = (unsigned char)((value >> 16) & 0xff);
+  p[3] = (unsigned char)((value >> 24) & 0xff);
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+
+// Tables are written as the column count, one alignment per column, the row
+// count and the non-empty cell count; rows as their header flag; cells as
+// their column span, row span and index.  Nodes without data, like filler
+// cells of incomplete rows, are written empty.
+static size_t opaque_serialize(cmark_syntax_extension *self, cmark_node *node,
+                               unsigned char *buf, size_t size) {
+  if (node->as.opaque == NULL) {
+    return 0;
+  } else if (node->type == CMARK_NODE_TABLE) {
+    node_table *t = (node_table *)node->as.opaque;
+    size_t len = 4 + t->n_columns + 8;
+    if (len <= size) {
+      put_u32(buf, t->n_columns);
+      if (t->n_columns)
+        memcpy(buf + 4, t->alignments, t->n_columns);
+      put_u32(buf + 4 + t->n_columns, (uint32_t)t->n_rows);
+      put_u32(buf + 8 + t->n_columns, (uint32_t)t->n_nonempty_cells);
+    }
+    return len;
+  } else if (node->type == CMARK_NODE_TABLE_ROW) {
+    if (size >= 1)
+      buf[0] = ((node_table_row *)node->as.opaque)->is_header;
+    return 1;
+  } else if (node->type == CMARK_NODE_TABLE_CELL) {
+    node_cell_data *data = (node_cell_data *)node->as.opaque;
+    if (size >= 12) {
+      put_u32(buf, data->colspan);
+      put_u32(buf + 4, data->rowspan);
+      put_u32(buf + 8, (uint32_t)data->cell_index);
+    }
+    return 12;
+  }
+  return 0;
+}
+
+// The node is read after it is linked to its parent, whose data is read
+// already.  The renderers reach from a cell into its row and table, so rows
+// and cells are only accepted in their place, and a cell's index and spans
+// only within its table.  A span can count the cells of a row beyond the
+// columns of its table, but not more cells than a row has.
+static int opaque_deserialize(cmark_syntax_extension *self, cmark_mem *mem,
+                              cmark_node *node, const unsigned char *data,
+                              size_t len) {
+  cmark_node *row = node->parent;
+  node_table *table = NULL;
+
+  if (node->type == CMARK_NODE_TABLE_ROW) {
+    if (!row || row->type != CMARK_NODE_TABLE || !row->as.opaque)
+      return 0;
+  } else if (node->type == CMARK_NODE_TABLE_CELL) {
+    if (!row || row->type != CMARK_NODE_TABLE_ROW || !row->as.opaque ||
+        !row->parent || row->parent->type != CMARK_NODE_TABLE ||
+        !row->parent->as.opaque)
+      return 0;
+    table = (node_table *)row->parent->as.opaque;
+  }
+
+  if (len == 0) {
+    // Only filler cells of incomplete rows are written without data.
+    if (node->type != CMARK_NODE_TABLE_CELL)
+      return 0;
+    opaque_free(self, mem, node);
+    node->as.opaque = NULL;
+    return 1;
+  } else if (node->type == CMARK_NODE_TABLE) {
+    node_table *t = (node_table *)node->as.opaque;
+    uint32_t n_columns;
+    if (len < 4)
+      return 0;
+    n_columns = get_u32(data);
+    if (n_columns > UINT16_MAX || len != 4 + (size_t)n_columns + 8)
+      return 0;
+    t->n_columns = (uint16_t)n_columns;
+    t->alignments = (uint8_t *)mem->calloc(n_columns + 1, sizeof(uint8_t));
+    memcpy(t->alignments, data + 4, n_columns);
+    t->n_rows = (int)get_u32(data + 4 + n_columns);
+    t->n_nonempty_cells = (int)get_u32(data + 8 + n_columns);
+    return t->n_rows >= 0 && t->n_nonempty_cells >= 0;
+  } else if (node->type == CMARK_NODE_TABLE_ROW) {
+    if (len != 1)
+      return 0;
+    ((node_table_row *)node->as.opaque)->is_header = data[0] != 0;
+    return 1;
+  } else if (node->type == CMARK_NODE_TABLE_CELL) {
+    node_cell_data *cell = (node_cell_data *)node->as.opaque;
+    if (len != 12)
+      return 0;
+    cell->colspan = get_u32(data);
+    cell->rowspan = get_u32(data + 4);
+    cell->cell_index = (int)get_u32(data + 8);
+    return cell->cell_index >= 0 && cell->cell_index < table->n_columns &&
+           cell->colspan <= UINT16_MAX &&
+           cell->rowspan <= (unsigned)table->n_rows;
+  }
+  return 0;
+}
+
 static int escape(cmark_syntax_extension *self, cmark_node *node, int c) {
   return
     node->type != CMARK_NODE_TABLE &&
@@ -1060,10 +1216,22 @@ static int escape(cmark_syntax_extension *self, cmark_node *node, int c) {
 
 cmark_syntax_extension *create_table_extension(void) {
   cmark_syntax_extension *self = cmark_syntax_extension_new("table");
+  cmark_llist *start_chars = NULL;
 
   cmark_register_node_flag(&CMARK_NODE__TABLE_VISITED);
   cmark_syntax_extension_set_match_block_func(self, matches);
   cmark_syntax_extension_set_open_block_func(self, try_opening_table_block);
+
+  // The bytes a delimiter row can start with. The rows after it are in a
+  // table, which this extension is always asked about.
+  cmark_mem *mem = cmark_get_default_mem_allocator();
+  start_chars = cmark_llist_append(mem, start_chars, (void *)'|');
+  start_chars = cmark_llist_append(mem, start_chars, (void *)':');
+  start_chars = cmark_llist_append(mem, start_chars, (void *)'-');
+  start_chars = cmark_llist_append(mem, start_chars, (void *)'\v');
+  start_chars = cmark_llist_append(mem, start_chars, (void *)'\f');
+  cmark_syntax_extension_set_block_start_chars(self, start_chars);
+
   cmark_syntax_extension_set_get_type_string_func(self, get_type_string);
   cmark_syntax_extension_set_can_contain_func(self, can_contain);
   cmark_syntax_extension_set_contains_inlines_func(self, contains_inlines);
@@ -1075,6 +1243,8 @@ cmark_syntax_extension *create_table_extension(void) {
   cmark_syntax_extension_set_html_render_func(self, html_render);
   cmark_syntax_extension_set_opaque_alloc_func(self, opaque_alloc);
   cmark_syntax_extension_set_opaque_free_func(self, opaque_free);
+  cmark_syntax_extension_set_opaque_serialize_func(self, opaque_serialize);
+  cmark_syntax_extension_set_opaque_deserialize_func(self, opaque_deserialize);
   cmark_syntax_extension_set_commonmark_escape_func(self, escape);
   CMARK_NODE_TABLE = cmark_syntax_extension_add_node(0);
   CMARK_NODE_TABLE_ROW = cmark_syntax_extension_add_node(0);
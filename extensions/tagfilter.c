@@ -2,54 +2,72 @@
 #include <parser.h>
 #include <ctype.h>
 
-static const char *blacklist[] = {
-    "title",   "textarea", "style",  "xmp",       "iframe",
-    "noembed", "noframes", "script", "plaintext", NULL,
-};
-
-static int is_tag(const unsigned char *tag_data, size_t tag_size,
-                  const char *tagname) {
+// The blacklisted tag names are:
+//
+//   title, textarea, style, xmp, iframe, noembed, noframes, script, plaintext
+//
+// Their length and first letter tell them apart, so a tag name is checked
+// against at most one of them.
+static int is_blacklisted(const unsigned char *name, size_t len) {
+  const char *tagname;
   size_t i;
 
-  if (tag_size < 3 || tag_data[0] != '<')
+  switch (len) {
+  case 3:
+    tagname = "xmp";
+    break;
+  case 5:
+    tagname = tolower(name[0]) == 't' ? "title" : "style";
+    break;
+  case 6:
+    tagname = tolower(name[0]) == 'i' ? "iframe" : "script";
+    break;
+  case 7:
+    tagname = "noembed";
+    break;
+  case 8:
+    tagname = tolower(name[0]) == 't' ? "textarea" : "noframes";
+    break;
+  case 9:
+    tagname = "plaintext";
+    break;
+  default:
     return 0;
-
-  i = 1;
-
-  if (tag_data[i] == '/') {
-    i++;
   }
 
-  for (; i < tag_size; ++i, ++tagname) {
-    if (*tagname == 0)
-      break;
-
-    if (tolower(tag_data[i]) != *tagname)
+  for (i = 0; i < len; ++i)
+    if (tolower(name[i]) != tagname[i])
       return 0;
-  }
 
-  if (i == tag_size)
-    return 0;
-
-  if (cmark_isspace(tag_data[i]) || tag_data[i] == '>')
-    return 1;
-
-  if (tag_data[i] == '/' && tag_size >= i + 2 && tag_data[i + 1] == '>')
-    return 1;
-
-  return 0;
+  return 1;
 }
 
 static int filter(cmark_syntax_extension *ext, const unsigned char *tag,
                   size_t tag_len) {
-  const char **it;
+  size_t i, start;
 
-  for (it = blacklist; *it; ++it) {
-    if (is_tag(tag, tag_len, *it)) {
-      return 0;
-    }
+  if (tag_len < 3 || tag[0] != '<')
+    return 1;
+
+  i = 1;
+
+  if (tag[i] == '/') {
+    i++;
   }
 
+  start = i;
+  while (i < tag_len && cmark_isalpha(tag[i]))
+    i++;
+
+  if (i == tag_len || !is_blacklisted(tag + start, i - start))
+    return 1;
+
+  if (cmark_isspace(tag[i]) || tag[i] == '>')
+    return 0;
+
+  if (tag[i] == '/' && tag_len >= i + 2 && tag[i + 1] == '>')
+    return 0;
+
   return 1;
 }
 
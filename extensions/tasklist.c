@@ -146,10 +146,20 @@ static const char *xml_attr(cmark_syntax_extension *extension,
 
 cmark_syntax_extension *create_tasklist_extension(void) {
   cmark_syntax_extension *ext = cmark_syntax_extension_new("tasklist");
+  cmark_llist *start_chars = NULL;
+  const char *c;
 
   cmark_syntax_extension_set_match_block_func(ext, matches);
   cmark_syntax_extension_set_get_type_string_func(ext, get_type_string);
   cmark_syntax_extension_set_open_block_func(ext, open_tasklist_item);
+
+  // The checkbox of an item opened on the same line, or the marker of one
+  // that scan_tasklist finds on a line continuing an item. \v and \f are
+  // spaces to the scanner, but not to the parser.
+  cmark_mem *mem = cmark_get_default_mem_allocator();
+  for (c = "[-+*0123456789\v\f"; *c; ++c)
+    start_chars = cmark_llist_append(mem, start_chars, (void *)(size_t)*c);
+  cmark_syntax_extension_set_block_start_chars(ext, start_chars);
   cmark_syntax_extension_set_can_contain_func(ext, can_contain);
   cmark_syntax_extension_set_commonmark_render_func(ext, commonmark_render);
   cmark_syntax_extension_set_plaintext_render_func(ext, commonmark_render);
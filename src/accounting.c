@@ -0,0 +1,201 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cmark-gfm.h"
+#include "accounting.h"
+#include "mutex.h"
+
+CMARK_DEFINE_LOCK(accounting)
+
+// The functions of a cmark_mem get no context, so each accounting
+// allocator in use gets one of a fixed number of slots, with functions of
+// its own that know their slot.
+#define NUM_SLOTS 64
+
+typedef struct {
+  cmark_mem mem;
+  cmark_mem_stats stats;
+  bool in_use;
+} accounting_slot;
+
+static accounting_slot slots[NUM_SLOTS];
+
+// Each allocation is preceded by its size and slot, padded to the
+// strictest alignment of the basic types to keep the alignment of the
+// system allocator.
+typedef union {
+  struct {
+    size_t size;
+    accounting_slot *slot;
+  } s;
+  long double align_ld;
+  long long align_ll;
+  void *align_p;
+  void (*align_fp)(void);
+} header;
+
+static void S_count(accounting_slot *slot, size_t old_size, size_t size) {
+  cmark_mem_stats *stats = &slot->stats;
+
+  stats->current_bytes = stats->current_bytes - old_size + size;
+  if (stats->current_bytes > stats->peak_bytes)
+    stats->peak_bytes = stats->current_bytes;
+  if (stats->budget && stats->current_bytes > stats->budget)
+    stats->over_budget = 1;
+}
+
+// A block reallocated through another slot than it was allocated through
+// moves to that slot.
+static void *S_realloc(accounting_slot *slot, void *ptr, size_t size) {
+  header *h = ptr ? (header *)ptr - 1 : NULL;
+  size_t old_size = h ? h->s.size : 0;
+  accounting_slot *old_slot = h ? h->s.slot : slot;
+
+  h = (header *)realloc(h, sizeof(header) + size);
+  if (!h) {
+    fprintf(stderr, "[cmark] realloc returned null pointer, aborting\n");
+    abort();
+  }
+  h->s.size = size;
+  h->s.slot = slot;
+
+  slot->stats.allocations++;
+  if (old_slot == slot) {
+    S_count(slot, old_size, size);
+  } else {
+    S_count(old_slot, old_size, 0);
+    S_count(slot, 0, size);
+  }
+  return h + 1;
+}
+
+static void *S_calloc(accounting_slot *slot, size_t nmem, size_t size) {
+  header *h;
+
+  if (size && nmem > (SIZE_MAX - sizeof(header)) / size) {
+    fprintf(stderr, "[cmark] calloc returned null pointer, aborting\n");
+    abort();
+  }
+  h = (header *)calloc(1, sizeof(header) + nmem * size);
+  if (!h) {
+    fprintf(stderr, "[cmark] calloc returned null pointer, aborting\n");
+    abort();
+  }
+  h->s.size = nmem * size;
+  h->s.slot = slot;
+
+  slot->stats.allocations++;
+  S_count(slot, 0, h->s.size);
+  return h + 1;
+}
+
+static void S_free(void *ptr) {
+  header *h;
+
+  if (!ptr)
+    return;
+  h = (header *)ptr - 1;
+  S_count(h->s.slot, h->s.size, 0);
+  free(h);
+}
+
+#define SLOT(i)                                                                \
+  static void *S_calloc_##i(size_t nmem, size_t size) {                        \
+    return S_calloc(&slots[i], nmem, size);                                    \
+  }                                                                            \
+  static void *S_realloc_##i(void *ptr, size_t size) {                         \
+    return S_realloc(&slots[i], ptr, size);                                    \
+  }
+
+SLOT(0) SLOT(1) SLOT(2) SLOT(3) SLOT(4) SLOT(5) SLOT(6) SLOT(7)
+SLOT(8) SLOT(9) SLOT(10) SLOT(11) SLOT(12) SLOT(13) SLOT(14) SLOT(15)
+SLOT(16) SLOT(17) SLOT(18) SLOT(19) SLOT(20) SLOT(21) SLOT(22) SLOT(23)
+SLOT(24) SLOT(25) SLOT(26) SLOT(27) SLOT(28) SLOT(29) SLOT(30) SLOT(31)
+SLOT(32) SLOT(33) SLOT(34) SLOT(35) SLOT(36) SLOT(37) SLOT(38) SLOT(39)
+SLOT(40) SLOT(41) SLOT(42) SLOT(43) SLOT(44) SLOT(45) SLOT(46) SLOT(47)
+SLOT(48) SLOT(49) SLOT(50) SLOT(51) SLOT(52) SLOT(53) SLOT(54) SLOT(55)
+SLOT(56) SLOT(57) SLOT(58) SLOT(59) SLOT(60) SLOT(61) SLOT(62) SLOT(63)
+
+#undef SLOT
+#define SLOT(i) {S_calloc_##i, S_realloc_##i, S_free},
+
+static const cmark_mem slot_mems[NUM_SLOTS] = {
+    SLOT(0) SLOT(1) SLOT(2) SLOT(3) SLOT(4) SLOT(5) SLOT(6) SLOT(7)
+    SLOT(8) SLOT(9) SLOT(10) SLOT(11) SLOT(12) SLOT(13) SLOT(14) SLOT(15)
+    SLOT(16) SLOT(17) SLOT(18) SLOT(19) SLOT(20) SLOT(21) SLOT(22) SLOT(23)
+    SLOT(24) SLOT(25) SLOT(26) SLOT(27) SLOT(28) SLOT(29) SLOT(30) SLOT(31)
+    SLOT(32) SLOT(33) SLOT(34) SLOT(35) SLOT(36) SLOT(37) SLOT(38) SLOT(39)
+    SLOT(40) SLOT(41) SLOT(42) SLOT(43) SLOT(44) SLOT(45) SLOT(46) SLOT(47)
+    SLOT(48) SLOT(49) SLOT(50) SLOT(51) SLOT(52) SLOT(53) SLOT(54) SLOT(55)
+    SLOT(56) SLOT(57) SLOT(58) SLOT(59) SLOT(60) SLOT(61) SLOT(62) SLOT(63)
+};
+
+#undef SLOT
+
+static accounting_slot *S_slot(cmark_mem *mem) {
+  if (mem == NULL || mem->free != S_free)
+    return NULL;
+  return (accounting_slot *)mem;
+}
+
+cmark_mem *cmark_accounting_mem_new(size_t budget) {
+  accounting_slot *slot = NULL;
+  int i;
+
+  CMARK_INITIALIZE_AND_LOCK(accounting);
+  for (i = 0; i < NUM_SLOTS; ++i) {
+    if (!slots[i].in_use) {
+      slot = &slots[i];
+      slot->in_use = true;
+      break;
+    }
+  }
+  CMARK_UNLOCK(accounting);
+
+  if (!slot)
+    return NULL;
+
+  slot->mem = slot_mems[slot - slots];
+  memset(&slot->stats, 0, sizeof(slot->stats));
+  slot->stats.budget = budget;
+  return &slot->mem;
+}
+
+void cmark_accounting_mem_free(cmark_mem *mem) {
+  accounting_slot *slot = S_slot(mem);
+
+  if (!slot)
+    return;
+
+  CMARK_INITIALIZE_AND_LOCK(accounting);
+  slot->in_use = false;
+  CMARK_UNLOCK(accounting);
+}
+
+int cmark_accounting_mem_get_stats(cmark_mem *mem, cmark_mem_stats *stats) {
+  accounting_slot *slot = S_slot(mem);
+
+  if (!slot)
+    return 0;
+  *stats = slot->stats;
+  return 1;
+}
+
+void cmark_accounting_mem_reset_stats(cmark_mem *mem) {
+  accounting_slot *slot = S_slot(mem);
+
+  if (!slot)
+    return;
+  slot->stats.peak_bytes = slot->stats.current_bytes;
+  slot->stats.allocations = 0;
+  slot->stats.over_budget =
+      slot->stats.budget && slot->stats.current_bytes > slot->stats.budget;
+}
+
+const int *cmark_accounting_mem_over_budget(cmark_mem *mem) {
+  accounting_slot *slot = S_slot(mem);
+
+  return slot && slot->stats.budget ? &slot->stats.over_budget : NULL;
+}
@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "accounting.h"
 #include "cmark_ctype.h"
 #include "syntax_extension.h"
 #include "parser.h"
@@ -23,6 +24,8 @@
 #include "houdini.h"
 #include "buffer.h"
 #include "footnotes.h"
+#include "iterator.h"
+#include "html.h"
 
 #define CODE_INDENT 4
 #define TAB_STOP 4
@@ -41,6 +44,39 @@
 
 #define peek_at(i, n) (i)->data[n]
 
+// The block starts that a line can begin with, by its first non-space byte,
+// so that open_new_blocks() only tries the ones that can match it.
+#define BLOCK_START_ATX (1 << 0)
+#define BLOCK_START_FENCE (1 << 1)
+#define BLOCK_START_HTML (1 << 2)
+#define BLOCK_START_SETEXT (1 << 3)
+#define BLOCK_START_THEMATIC_BREAK (1 << 4)
+#define BLOCK_START_FOOTNOTE (1 << 5)
+#define BLOCK_START_LIST (1 << 6)
+#define BLOCK_START_QUOTE (1 << 7)
+// Set for the start characters of the attached extensions, see
+// cmark_syntax_extension_set_block_start_chars().
+#define BLOCK_START_EXTENSION (1 << 8)
+
+static uint16_t default_block_starts[256] = {
+    ['#'] = BLOCK_START_ATX,
+    ['`'] = BLOCK_START_FENCE,
+    ['~'] = BLOCK_START_FENCE,
+    ['<'] = BLOCK_START_HTML,
+    ['='] = BLOCK_START_SETEXT,
+    ['-'] = BLOCK_START_SETEXT | BLOCK_START_THEMATIC_BREAK | BLOCK_START_LIST,
+    ['*'] = BLOCK_START_THEMATIC_BREAK | BLOCK_START_LIST,
+    ['_'] = BLOCK_START_THEMATIC_BREAK,
+    ['['] = BLOCK_START_FOOTNOTE,
+    ['+'] = BLOCK_START_LIST,
+    ['0'] = BLOCK_START_LIST, ['1'] = BLOCK_START_LIST,
+    ['2'] = BLOCK_START_LIST, ['3'] = BLOCK_START_LIST,
+    ['4'] = BLOCK_START_LIST, ['5'] = BLOCK_START_LIST,
+    ['6'] = BLOCK_START_LIST, ['7'] = BLOCK_START_LIST,
+    ['8'] = BLOCK_START_LIST, ['9'] = BLOCK_START_LIST,
+    ['>'] = BLOCK_START_QUOTE,
+};
+
 static bool S_last_line_blank(const cmark_node *node) {
   return (node->flags & CMARK_NODE__LAST_LINE_BLANK) != 0;
 }
@@ -76,14 +112,15 @@ static void S_parser_feed(cmark_parser *parser, const unsigned char *buffer,
                           size_t len, bool eof);
 
 static void S_process_line(cmark_parser *parser, const unsigned char *buffer,
-                           bufsize_t bytes, bool ensureEndsInNewline);
+                           bufsize_t bytes, bool ensureEndsInNewline,
+                           bool validUTF8);
 
 static cmark_node *make_block(cmark_mem *mem, cmark_node_type tag,
                               int start_line, int start_column) {
   cmark_node *e;
 
   e = (cmark_node *)mem->calloc(1, sizeof(*e));
-  cmark_strbuf_init(mem, &e->content, 32);
+  cmark_strbuf_init(mem, &e->content, 0);
   e->type = (uint16_t)tag;
   e->flags = CMARK_NODE__OPEN;
   e->start_line = start_line;
@@ -99,6 +136,61 @@ static cmark_node *make_document(cmark_mem *mem) {
   return e;
 }
 
+static cmark_syntax_extension *no_block_extensions[] = {NULL};
+
+// Index the inline syntax extensions of 'parser' by the special characters
+// they handle, for try_extensions and get_extension_for_special_char in
+// inlines.c.
+static void S_index_inline_extensions(cmark_parser *parser) {
+  cmark_mem *mem = parser->mem;
+  uint16_t *index;
+  cmark_syntax_extension **exts;
+  bool handles[256];
+  cmark_llist *tmp, *tmp_char;
+  int c, n = 0;
+
+  mem->free(parser->inline_extension_index);
+  mem->free(parser->inline_extensions);
+
+  // Count the extensions for each character at index[c + 1], then turn the
+  // counts into the offsets of the first ones.
+  index = (uint16_t *)mem->calloc(257, sizeof(uint16_t));
+  for (tmp = parser->inline_syntax_extensions; tmp; tmp = tmp->next) {
+    cmark_syntax_extension *ext = (cmark_syntax_extension *)tmp->data;
+
+    memset(handles, 0, sizeof(handles));
+    for (tmp_char = ext->special_inline_chars; tmp_char; tmp_char = tmp_char->next)
+      handles[(unsigned char)(size_t)tmp_char->data] = true;
+    for (c = 0; c < 256; ++c) {
+      if (handles[c]) {
+        index[c + 1]++;
+        n++;
+      }
+    }
+  }
+  for (c = 0; c < 256; ++c)
+    index[c + 1] += index[c];
+
+  // Fill in the extensions, using index[c] as the next free slot for 'c',
+  // which leaves it at the offset of the next character's first one.
+  exts = (cmark_syntax_extension **)mem->calloc(n ? n : 1, sizeof(*exts));
+  for (tmp = parser->inline_syntax_extensions; tmp; tmp = tmp->next) {
+    cmark_syntax_extension *ext = (cmark_syntax_extension *)tmp->data;
+
+    memset(handles, 0, sizeof(handles));
+    for (tmp_char = ext->special_inline_chars; tmp_char; tmp_char = tmp_char->next)
+      handles[(unsigned char)(size_t)tmp_char->data] = true;
+    for (c = 0; c < 256; ++c)
+      if (handles[c])
+        exts[index[c]++] = ext;
+  }
+  memmove(index + 1, index, 256 * sizeof(uint16_t));
+  index[0] = 0;
+
+  parser->inline_extension_index = index;
+  parser->inline_extensions = exts;
+}
+
 int cmark_parser_attach_syntax_extension(cmark_parser *parser,
                                          cmark_syntax_extension *extension) {
   parser->syntax_extensions = cmark_llist_append(parser->mem, parser->syntax_extensions, extension);
@@ -115,6 +207,34 @@ int cmark_parser_attach_syntax_extension(cmark_parser *parser,
 
     parser->inline_syntax_extensions = cmark_llist_append(
       parser->mem, parser->inline_syntax_extensions, extension);
+    S_index_inline_extensions(parser);
+  }
+
+  if (extension->html_filter_func)
+    parser->html_filter_extensions = cmark_llist_append(
+      parser->mem, parser->html_filter_extensions, extension);
+
+  if (extension->try_opening_block) {
+    int c, n = 0;
+
+    while (parser->block_extensions[n])
+      n++;
+    if (parser->block_extensions == no_block_extensions)
+      parser->block_extensions = NULL;
+    parser->block_extensions = (cmark_syntax_extension **)parser->mem->realloc(
+        parser->block_extensions, (n + 2) * sizeof(cmark_syntax_extension *));
+    parser->block_extensions[n] = extension;
+    parser->block_extensions[n + 1] = NULL;
+
+    if (parser->block_starts == default_block_starts) {
+      parser->block_starts = (uint16_t *)parser->mem->calloc(sizeof(uint16_t), 256);
+      memcpy(parser->block_starts, default_block_starts, sizeof(default_block_starts));
+    }
+
+    for (c = 0; c < 256; ++c) {
+      if (!extension->block_start_chars || extension->block_start_table[c])
+        parser->block_starts[c] |= BLOCK_START_EXTENSION;
+    }
   }
 
   return 1;
@@ -126,23 +246,56 @@ static void cmark_parser_dispose(cmark_parser *parser) {
 
   if (parser->refmap)
     cmark_map_free(parser->refmap);
+
+  cmark_interner_clear(&parser->interner);
 }
 
 static void cmark_parser_reset(cmark_parser *parser) {
   cmark_llist *saved_exts = parser->syntax_extensions;
   cmark_llist *saved_inline_exts = parser->inline_syntax_extensions;
+  cmark_llist *saved_html_filter_exts = parser->html_filter_extensions;
   int saved_options = parser->options;
   cmark_mem *saved_mem = parser->mem;
   int8_t *saved_specials = parser->special_chars;
   int8_t *saved_skips = parser->skip_chars;
+  uint16_t *saved_block_starts = parser->block_starts;
+  cmark_syntax_extension **saved_block_exts = parser->block_extensions;
+  uint16_t *saved_inline_ext_index = parser->inline_extension_index;
+  cmark_syntax_extension **saved_inline_exts_by_char = parser->inline_extensions;
+  cmark_strbuf saved_content = parser->content;
+  cmark_strbuf saved_curline = parser->curline;
+  cmark_interner saved_interner = parser->interner;
+  cmark_node **saved_open_blocks = parser->open_blocks;
+  bufsize_t saved_open_blocks_size = parser->open_blocks_size;
+  cmark_parser_cancel_func saved_cancel_func = parser->cancel_func;
+  void *saved_cancel_data = parser->cancel_data;
+  const int *saved_over_budget = parser->over_budget;
 
   cmark_parser_dispose(parser);
 
   memset(parser, 0, sizeof(cmark_parser));
   parser->mem = saved_mem;
 
-  cmark_strbuf_init(parser->mem, &parser->curline, 256);
+  // The line buffer is kept for the next document, like the content
+  // buffer, so that parsing many short documents doesn't allocate it again
+  // for each.
+  if (saved_curline.mem) {
+    parser->curline = saved_curline;
+    cmark_strbuf_clear(&parser->curline);
+  } else {
+    cmark_strbuf_init(parser->mem, &parser->curline, 256);
+  }
   cmark_strbuf_init(parser->mem, &parser->linebuf, 0);
+  if (saved_content.mem)
+    parser->content = saved_content;
+  else
+    cmark_strbuf_init(parser->mem, &parser->content, 0);
+
+  // Like the buffers, the interner's table is kept for the next document.
+  if (saved_interner.mem)
+    parser->interner = saved_interner;
+  else
+    cmark_interner_init(&parser->interner, parser->mem);
 
   cmark_node *document = make_document(parser->mem);
 
@@ -150,20 +303,44 @@ static void cmark_parser_reset(cmark_parser *parser) {
   parser->root = document;
   parser->current = document;
 
+  if (saved_open_blocks) {
+    parser->open_blocks = saved_open_blocks;
+    parser->open_blocks_size = saved_open_blocks_size;
+  } else {
+    parser->open_blocks_size = 8;
+    parser->open_blocks = (cmark_node **)parser->mem->calloc(
+        parser->open_blocks_size, sizeof(cmark_node *));
+  }
+  parser->open_blocks[0] = document;
+  parser->num_open_blocks = 1;
+
   parser->syntax_extensions = saved_exts;
   parser->inline_syntax_extensions = saved_inline_exts;
+  parser->html_filter_extensions = saved_html_filter_exts;
   parser->options = saved_options;
 
   parser->special_chars = saved_specials;
   parser->skip_chars = saved_skips;
+  parser->block_starts = saved_block_starts;
+  parser->block_extensions = saved_block_exts;
+  parser->inline_extension_index = saved_inline_ext_index;
+  parser->inline_extensions = saved_inline_exts_by_char;
+
+  parser->cancel_func = saved_cancel_func;
+  parser->cancel_data = saved_cancel_data;
+  parser->over_budget = saved_over_budget;
+  parser->cancel_countdown = CMARK_CANCEL_INTERVAL;
 }
 
 cmark_parser *cmark_parser_new_with_mem(int options, cmark_mem *mem) {
   cmark_parser *parser = (cmark_parser *)mem->calloc(1, sizeof(cmark_parser));
   parser->mem = mem;
   parser->options = options;
+  parser->over_budget = cmark_accounting_mem_over_budget(mem);
   cmark_set_default_skip_chars(&parser->skip_chars, false);
   cmark_set_default_special_chars(&parser->special_chars, false);
+  parser->block_starts = default_block_starts;
+  parser->block_extensions = no_block_extensions;
   cmark_parser_reset(parser);
   return parser;
 }
@@ -182,11 +359,22 @@ void cmark_parser_free(cmark_parser *parser) {
     mem->free(parser->skip_chars);
   }
 
+  if (parser->block_starts != default_block_starts)
+    mem->free(parser->block_starts);
+  if (parser->block_extensions != no_block_extensions)
+    mem->free(parser->block_extensions);
+  mem->free(parser->inline_extension_index);
+  mem->free(parser->inline_extensions);
+
   cmark_parser_dispose(parser);
+  cmark_interner_free(&parser->interner);
   cmark_strbuf_free(&parser->curline);
   cmark_strbuf_free(&parser->linebuf);
+  cmark_strbuf_free(&parser->content);
+  mem->free(parser->open_blocks);
   cmark_llist_free(parser->mem, parser->syntax_extensions);
   cmark_llist_free(parser->mem, parser->inline_syntax_extensions);
+  cmark_llist_free(parser->mem, parser->html_filter_extensions);
   mem->free(parser);
 }
 
@@ -232,6 +420,12 @@ static void add_line(cmark_node *node, cmark_chunk *ch, cmark_parser *parser) {
   int chars_to_tab;
   int i;
   assert(node->flags & CMARK_NODE__OPEN);
+  if (node->content.asize == 0 && parser->content.asize > 0) {
+    // Collect the lines in the parser's buffer, already grown by earlier
+    // blocks; see S_detach_content.
+    node->content = parser->content;
+    cmark_strbuf_init(parser->mem, &parser->content, 0);
+  }
   if (parser->partially_consumed_tab) {
     parser->offset += 1; // skip over tab
     // add space characters:
@@ -244,6 +438,54 @@ static void add_line(cmark_node *node, cmark_chunk *ch, cmark_parser *parser) {
                    ch->len - parser->offset);
 }
 
+// Return the content of 'b' from 'offset' on, in a buffer of its own size.
+// The buffer the lines were collected in is kept by the parser for the
+// next leaf block, so that it isn't grown again for every block.
+static cmark_chunk S_detach_content(cmark_parser *parser, cmark_node *b,
+                                    bufsize_t offset) {
+  cmark_strbuf *content = &b->content;
+  cmark_chunk c;
+
+  if (parser->content.asize > 0) {
+    cmark_strbuf_drop(content, offset);
+    return cmark_chunk_buf_detach(content);
+  }
+
+  c.len = content->size - offset;
+  c.data = (unsigned char *)parser->mem->realloc(NULL, c.len + 1);
+  memcpy(c.data, content->ptr + offset, c.len);
+  c.data[c.len] = '\0';
+  c.alloc = 1;
+
+  cmark_strbuf_clear(content);
+  parser->content = *content;
+  cmark_strbuf_init(parser->mem, content, 0);
+  return c;
+}
+
+// Like S_detach_content, leaving the result as the content of 'b', for
+// blocks whose content is parsed for inlines later.
+static void S_shrink_content(cmark_parser *parser, cmark_node *b,
+                             bufsize_t offset) {
+  cmark_chunk c;
+
+  if (b->content.asize == 0)
+    return;
+  if (offset == b->content.size) {
+    cmark_strbuf_clear(&b->content);
+    if (parser->content.asize == 0) {
+      parser->content = b->content;
+      cmark_strbuf_init(parser->mem, &b->content, 0);
+    }
+    return;
+  }
+
+  c = S_detach_content(parser, b, offset);
+  b->content.ptr = c.data;
+  b->content.size = c.len;
+  b->content.asize = c.len + 1;
+}
+
 static void remove_trailing_blank_lines(cmark_strbuf *ln) {
   bufsize_t i;
   unsigned char c;
@@ -286,8 +528,8 @@ static bool S_ends_with_blank_line(cmark_node *node) {
   }
 }
 
-// returns true if content remains after link defs are resolved.
-static bool resolve_reference_link_definitions(
+// returns the length of the link defs at the start of the paragraph.
+static bufsize_t resolve_reference_link_definitions(
 		cmark_parser *parser,
                 cmark_node *b) {
   bufsize_t pos;
@@ -301,8 +543,7 @@ static bool resolve_reference_link_definitions(
     chunk.data += pos;
     chunk.len -= pos;
   }
-  cmark_strbuf_drop(node_content, (node_content->size - chunk.len));
-  return !is_blank(&b->content, 0);
+  return node_content->size - chunk.len;
 }
 
 static cmark_node *finalize(cmark_parser *parser, cmark_node *b) {
@@ -341,7 +582,9 @@ static cmark_node *finalize(cmark_parser *parser, cmark_node *b) {
   switch (S_type(b)) {
   case CMARK_NODE_PARAGRAPH:
   {
-    has_content = resolve_reference_link_definitions(parser, b);
+    pos = resolve_reference_link_definitions(parser, b);
+    has_content = !is_blank(node_content, pos);
+    S_shrink_content(parser, b, pos);
     if (!has_content && (parser->options & CMARK_OPT_PRESERVE_WHITESPACE) == 0) {
       // remove blank node (former reference def)
       cmark_node_free(b);
@@ -353,6 +596,7 @@ static cmark_node *finalize(cmark_parser *parser, cmark_node *b) {
     if (!b->as.code.fenced) { // indented code
       remove_trailing_blank_lines(node_content);
       cmark_strbuf_putc(node_content, '\n');
+      pos = 0;
     } else {
       // first line of contents becomes info
       for (pos = 0; pos < node_content->size; ++pos) {
@@ -361,23 +605,35 @@ static cmark_node *finalize(cmark_parser *parser, cmark_node *b) {
       }
       assert(pos < node_content->size);
 
-      cmark_strbuf tmp = CMARK_BUF_INIT(parser->mem);
-      houdini_unescape_html_f(&tmp, node_content->ptr, pos);
-      cmark_strbuf_trim(&tmp);
-      cmark_strbuf_unescape(&tmp);
-      b->as.code.info = cmark_chunk_buf_detach(&tmp);
+      // Most info strings are a bare language name that recurs throughout
+      // the document, with nothing to unescape.
+      if (!memchr(node_content->ptr, '&', pos) &&
+          !memchr(node_content->ptr, '\\', pos)) {
+        cmark_chunk info = {node_content->ptr, pos, 0};
+        cmark_chunk_trim(&info);
+        b->as.code.info =
+            cmark_interner_intern(&parser->interner, info.data, info.len);
+      } else {
+        cmark_strbuf tmp = CMARK_BUF_INIT(parser->mem);
+        houdini_unescape_html_f(&tmp, node_content->ptr, pos);
+        cmark_strbuf_trim(&tmp);
+        cmark_strbuf_unescape(&tmp);
+        b->as.code.info =
+            cmark_interner_intern(&parser->interner, tmp.ptr, tmp.size);
+        cmark_strbuf_free(&tmp);
+      }
 
       if (node_content->ptr[pos] == '\r')
         pos += 1;
       if (node_content->ptr[pos] == '\n')
         pos += 1;
-      cmark_strbuf_drop(node_content, pos);
     }
-    b->as.code.literal = cmark_chunk_buf_detach(node_content);
+    b->as.code.literal = S_detach_content(parser, b, pos);
     break;
 
   case CMARK_NODE_HTML_BLOCK:
-    b->as.literal = cmark_chunk_buf_detach(node_content);
+    b->as.literal = S_detach_content(parser, b, 0);
+    cmark_html_classify(parser->html_filter_extensions, b);
     break;
 
   case CMARK_NODE_LIST:      // determine tight/loose status
@@ -410,6 +666,8 @@ static cmark_node *finalize(cmark_parser *parser, cmark_node *b) {
     break;
 
   default:
+    // headings and extension blocks
+    S_shrink_content(parser, b, 0);
     break;
   }
 
@@ -430,6 +688,7 @@ static cmark_node *add_child(cmark_parser *parser, cmark_node *parent,
   cmark_node *child =
       make_block(parser->mem, block_type, parser->line_number, start_column);
   child->parent = parent;
+  parser->node_count++;
 
   if (parent->last_child) {
     parent->last_child->next = child;
@@ -459,101 +718,205 @@ void cmark_manage_extensions_special_characters(cmark_parser *parser, int add) {
 }
 
 // Walk through node and all children, recursively, parsing
-// string content into inline content where appropriate.
+// string content into inline content where appropriate.  Footnote
+// definitions are collected into 'footnotes' on the way, if given.
 static void process_inlines(cmark_parser *parser,
-                            cmark_map *refmap, int options) {
-  cmark_iter *iter = cmark_iter_new(parser->root);
+                            cmark_map *refmap, int options,
+                            cmark_map *footnotes) {
+  cmark_iter iter;
   cmark_node *cur;
   cmark_event_type ev_type;
 
+  cmark_iter_init(&iter, parser->root);
   cmark_manage_extensions_special_characters(parser, true);
 
-  while ((ev_type = cmark_iter_next(iter)) != CMARK_EVENT_DONE) {
-    cur = cmark_iter_get_node(iter);
+  while ((ev_type = cmark_iter_next(&iter)) != CMARK_EVENT_DONE) {
+    cur = cmark_iter_get_node(&iter);
     if (ev_type == CMARK_EVENT_ENTER) {
       if (contains_inlines(cur)) {
         cmark_parse_inlines(parser, cur, refmap, options);
+        if (parser->cancelled)
+          break;
       }
+    } else if (footnotes && cur->type == CMARK_NODE_FOOTNOTE_DEFINITION) {
+      cmark_footnote_create(footnotes, cur);
     }
   }
 
   cmark_manage_extensions_special_characters(parser, false);
+}
 
-  cmark_iter_free(iter);
+// Mark every node that would be handled by process_inlines, leaving the
+// actual parsing to cmark_node_parse_pending_inlines.
+static void defer_inlines(cmark_parser *parser) {
+  cmark_iter iter;
+  cmark_node *cur;
+  cmark_event_type ev_type;
+
+  cmark_iter_init(&iter, parser->root);
+  while ((ev_type = cmark_iter_next(&iter)) != CMARK_EVENT_DONE) {
+    cur = cmark_iter_get_node(&iter);
+    if (ev_type == CMARK_EVENT_ENTER && contains_inlines(cur)) {
+      cur->flags |= CMARK_NODE__INLINES_PENDING;
+    }
+  }
 }
 
-static int sort_footnote_by_ix(const void *_a, const void *_b) {
-  cmark_footnote *a = *(cmark_footnote **)_a;
-  cmark_footnote *b = *(cmark_footnote **)_b;
-  return (int)a->ix - (int)b->ix;
+// Hand the reference map over to a parser owned by the document, set up
+// with the same options and extensions, so that deferred inlines can still
+// be parsed once 'parser' has been reset or freed.
+static void attach_inline_parser(cmark_parser *parser) {
+  cmark_parser *inline_parser =
+      cmark_parser_new_with_mem(parser->options, parser->mem);
+  cmark_llist *tmp;
+
+  for (tmp = parser->syntax_extensions; tmp; tmp = tmp->next)
+    cmark_parser_attach_syntax_extension(inline_parser,
+                                         (cmark_syntax_extension *)tmp->data);
+
+  if (parser->inline_syntax_extensions) {
+    memcpy(inline_parser->special_chars, parser->special_chars, 256);
+    memcpy(inline_parser->skip_chars, parser->skip_chars, 256);
+  }
+  inline_parser->backslash_ispunct = parser->backslash_ispunct;
+
+  cmark_map_free(inline_parser->refmap);
+  inline_parser->refmap = parser->refmap;
+  parser->refmap = NULL;
+
+  parser->root->as.document.inline_parser = inline_parser;
 }
 
-static void process_footnotes(cmark_parser *parser) {
-  // * Collect definitions in a map.
-  // * Iterate the references in the document in order, assigning indices to
-  //   definitions in the order they're seen.
-  // * Write out the footnotes at the bottom of the document in index order.
+void cmark_node_parse_pending_inlines(cmark_node *node) {
+  cmark_node *root = node;
+  cmark_parser *parser;
+  cmark_llist *extensions;
 
-  cmark_map *map = cmark_footnote_map_new(parser->mem);
+  // Clear the flag first: extensions may access the node while parsing.
+  node->flags &= ~CMARK_NODE__INLINES_PENDING;
 
-  cmark_iter *iter = cmark_iter_new(parser->root);
-  cmark_node *cur;
-  cmark_event_type ev_type;
+  while (root->parent)
+    root = root->parent;
+  if (root->type != CMARK_NODE_DOCUMENT)
+    return;
+  parser = root->as.document.inline_parser;
+  if (parser == NULL)
+    return;
+
+  cmark_manage_extensions_special_characters(parser, true);
+  cmark_parse_inlines(parser, node, parser->refmap, parser->options);
+  cmark_manage_extensions_special_characters(parser, false);
+
+  // What cmark_parser_finish does for the whole document in an eager parse.
+  cmark_consolidate_text_nodes(node);
+
+  for (extensions = parser->syntax_extensions; extensions; extensions = extensions->next) {
+    cmark_syntax_extension *ext = (cmark_syntax_extension *) extensions->data;
+    if (ext->postprocess_func)
+      ext->postprocess_func(ext, parser, node);
+  }
+}
 
-  while ((ev_type = cmark_iter_next(iter)) != CMARK_EVENT_DONE) {
-    cur = cmark_iter_get_node(iter);
-    if (ev_type == CMARK_EVENT_EXIT && cur->type == CMARK_NODE_FOOTNOTE_DEFINITION) {
-      cmark_footnote_create(map, cur);
+// Resolve a footnote reference to its definition, as looked up in the
+// footnote map, numbering the definition on its first reference.  Without a
+// definition the reference is turned into the text it was parsed from.
+static void resolve_footnote_reference(cmark_parser *parser,
+                                       cmark_footnote *footnote,
+                                       cmark_node *cur, unsigned int *ix) {
+  if (footnote) {
+    if (!footnote->ix) {
+      footnote->ix = ++*ix;
+      footnote->node->footnote_ix = footnote->ix;
     }
+
+    // store a reference to this footnote reference's footnote definition
+    // this is used by renderers when generating label ids
+    cur->parent_footnote_def = footnote->node;
+    cur->footnote_ix = footnote->ix;
+
+    // keep track of a) count of how many times this footnote def has been
+    // referenced, and b) which reference index this footnote ref is at.
+    // this is used by renderers when generating links and backreferences.
+    cur->footnote.ref_ix = ++footnote->node->footnote.def_count;
+    return;
   }
 
-  cmark_iter_free(iter);
-  iter = cmark_iter_new(parser->root);
+  cmark_strbuf buf = CMARK_BUF_INIT(parser->mem);
+  cmark_strbuf_grow(&buf, cur->as.literal.len + 3);
+  cmark_strbuf_puts(&buf, "[^");
+  cmark_strbuf_put(&buf, cur->as.literal.data, cur->as.literal.len);
+  cmark_strbuf_putc(&buf, ']');
+
+  cmark_chunk_free(parser->mem, &cur->as.literal);
+  cur->as.literal = cmark_chunk_buf_detach(&buf);
+  cur->type = (uint16_t)CMARK_NODE_TEXT;
+}
+
+// Whether 'node' is a footnote reference not resolved yet.
+static inline bool is_pending_footnote_reference(cmark_node *node) {
+  return node->type == CMARK_NODE_FOOTNOTE_REFERENCE &&
+         node->parent_footnote_def == NULL;
+}
+
+// The single walk over the parsed inlines: resolves footnote references
+// against 'footnotes', if given, and consolidates adjacent text nodes.
+// References are resolved in document order, before the text around them is
+// merged, so that unresolved ones are merged as plain text.
+static void finalize_inlines(cmark_parser *parser, cmark_map *footnotes) {
+  cmark_iter iter;
+  cmark_strbuf buf = CMARK_BUF_INIT(parser->mem);
+  cmark_event_type ev_type;
+  cmark_node *cur, *tmp;
   unsigned int ix = 0;
 
-  while ((ev_type = cmark_iter_next(iter)) != CMARK_EVENT_DONE) {
-    cur = cmark_iter_get_node(iter);
-    if (ev_type == CMARK_EVENT_EXIT && cur->type == CMARK_NODE_FOOTNOTE_REFERENCE) {
-      cmark_footnote *footnote = (cmark_footnote *)cmark_map_lookup(map, &cur->as.literal);
-      if (footnote) {
-        if (!footnote->ix)
-          footnote->ix = ++ix;
-
-        // store a reference to this footnote reference's footnote definition
-        // this is used by renderers when generating label ids
-        cur->parent_footnote_def = footnote->node;
-
-        // keep track of a) count of how many times this footnote def has been
-        // referenced, and b) which reference index this footnote ref is at.
-        // this is used by renderers when generating links and backreferences.
-        cur->footnote.ref_ix = ++footnote->node->footnote.def_count;
-
-        char n[32];
-        snprintf(n, sizeof(n), "%d", footnote->ix);
-        cmark_chunk_free(parser->mem, &cur->as.literal);
-        cmark_strbuf buf = CMARK_BUF_INIT(parser->mem);
-        cmark_strbuf_puts(&buf, n);
-
-        cur->as.literal = cmark_chunk_buf_detach(&buf);
-      } else {
-        cmark_node *text = (cmark_node *)parser->mem->calloc(1, sizeof(*text));
-        cmark_strbuf_init(parser->mem, &text->content, 0);
-        text->type = (uint16_t) CMARK_NODE_TEXT;
-
-        cmark_strbuf buf = CMARK_BUF_INIT(parser->mem);
-        cmark_strbuf_puts(&buf, "[^");
-        cmark_strbuf_put(&buf, cur->as.literal.data, cur->as.literal.len);
-        cmark_strbuf_putc(&buf, ']');
-
-        text->as.literal = cmark_chunk_buf_detach(&buf);
-        cmark_node_insert_after(cur, text);
-        cmark_node_free(cur);
+  cmark_iter_init(&iter, parser->root);
+  while ((ev_type = cmark_iter_next(&iter)) != CMARK_EVENT_DONE) {
+    if (ev_type != CMARK_EVENT_ENTER)
+      continue;
+    cur = cmark_iter_get_node(&iter);
+
+    if (footnotes && is_pending_footnote_reference(cur)) {
+      resolve_footnote_reference(
+          parser, (cmark_footnote *)cmark_map_lookup(footnotes, &cur->as.literal),
+          cur, &ix);
+      // A reference turned into text is a leaf now: step over it as one.
+      if (cur->type == CMARK_NODE_TEXT)
+        cmark_iter_reset(&iter, cur, CMARK_EVENT_ENTER);
+    }
+
+    if (cur->type != CMARK_NODE_TEXT)
+      continue;
+
+    if (footnotes) {
+      // Resolve the references among the following text: nothing between
+      // them and this node is left to number first.  Unresolved ones become
+      // text to merge.
+      for (tmp = cur->next; tmp; tmp = tmp->next) {
+        if (is_pending_footnote_reference(tmp))
+          resolve_footnote_reference(
+              parser,
+              (cmark_footnote *)cmark_map_lookup(footnotes, &tmp->as.literal),
+              tmp, &ix);
+        if (tmp->type != CMARK_NODE_TEXT)
+          break;
       }
     }
+
+    cmark_iter_merge_text(&iter, &buf);
   }
 
-  cmark_iter_free(iter);
+  cmark_strbuf_free(&buf);
+}
+
+static int sort_footnote_by_ix(const void *_a, const void *_b) {
+  cmark_footnote *a = *(cmark_footnote **)_a;
+  cmark_footnote *b = *(cmark_footnote **)_b;
+  return (int)a->ix - (int)b->ix;
+}
 
+// Write out the referenced footnotes at the bottom of the document in index
+// order, dropping the others, and free the map.
+static void append_footnotes(cmark_parser *parser, cmark_map *map) {
   if (map->sorted) {
     qsort(map->sorted, map->size, sizeof(cmark_map_entry *), sort_footnote_by_ix);
     for (unsigned int i = 0; i < map->size; ++i) {
@@ -572,14 +935,14 @@ static void process_footnotes(cmark_parser *parser) {
 }
 
 // Attempts to parse a list item marker (bullet or enumerated).
-// On success, returns length of the marker, and populates
-// data with the details.  On failure, returns 0.
-static bufsize_t parse_list_marker(cmark_mem *mem, cmark_chunk *input,
-                                   bufsize_t pos, bool interrupts_paragraph,
-                                   cmark_list **dataptr) {
+// On success, returns length of the marker, and fills in the caller's
+// 'data' with the details.  On failure, returns 0 and leaves 'data'
+// untouched.
+static bufsize_t parse_list_marker(cmark_chunk *input, bufsize_t pos,
+                                   bool interrupts_paragraph,
+                                   cmark_list *data) {
   unsigned char c;
   bufsize_t startpos;
-  cmark_list *data;
   bufsize_t i;
 
   startpos = pos;
@@ -602,7 +965,7 @@ static bufsize_t parse_list_marker(cmark_mem *mem, cmark_chunk *input,
       }
     }
 
-    data = (cmark_list *)mem->calloc(1, sizeof(*data));
+    memset(data, 0, sizeof(*data));
     data->marker_offset = 0; // will be adjusted later
     data->list_type = CMARK_BULLET_LIST;
     data->bullet_char = c;
@@ -642,7 +1005,7 @@ static bufsize_t parse_list_marker(cmark_mem *mem, cmark_chunk *input,
         }
       }
 
-      data = (cmark_list *)mem->calloc(1, sizeof(*data));
+      memset(data, 0, sizeof(*data));
       data->marker_offset = 0; // will be adjusted later
       data->list_type = CMARK_ORDERED_LIST;
       data->bullet_char = 0;
@@ -656,7 +1019,6 @@ static bufsize_t parse_list_marker(cmark_mem *mem, cmark_chunk *input,
     return 0;
   }
 
-  *dataptr = data;
   return (pos - startpos);
 }
 
@@ -668,7 +1030,14 @@ static int lists_match(cmark_list *list_data, cmark_list *item_data) {
           list_data->bullet_char == item_data->bullet_char);
 }
 
+static bool S_lazy_inlines(cmark_parser *parser) {
+  return (parser->options & CMARK_OPT_LAZY_INLINES) &&
+         !(parser->options & CMARK_OPT_FOOTNOTES);
+}
+
 static cmark_node *finalize_document(cmark_parser *parser) {
+  cmark_llist *tmp;
+
   while (parser->current != parser->root) {
     parser->current = finalize(parser, parser->current);
   }
@@ -682,9 +1051,35 @@ static cmark_node *finalize_document(cmark_parser *parser) {
   else
     parser->refmap->max_ref_size = 100000;
 
-  process_inlines(parser, parser->refmap, parser->options);
-  if (parser->options & CMARK_OPT_FOOTNOTES)
-    process_footnotes(parser);
+  if (S_lazy_inlines(parser)) {
+    defer_inlines(parser);
+  } else {
+    cmark_map *footnotes = NULL;
+
+    if (parser->options & CMARK_OPT_FOOTNOTES)
+      footnotes = cmark_footnote_map_new(parser->mem);
+
+    process_inlines(parser, parser->refmap, parser->options, footnotes);
+    if (parser->cancelled) {
+      // cmark_parser_finish frees the document
+      if (footnotes)
+        cmark_map_free(footnotes);
+      return parser->root;
+    }
+    finalize_inlines(parser, footnotes);
+
+    if (footnotes)
+      append_footnotes(parser, footnotes);
+  }
+
+  // Let renderers size their output buffers from the document up front.
+  parser->root->as.document.source_size = parser->total_size;
+  parser->root->as.document.node_count = parser->node_count;
+
+  // Record what the raw HTML was classified against.
+  for (tmp = parser->html_filter_extensions; tmp; tmp = tmp->next)
+    parser->root->as.document.html_filters = cmark_llist_append(
+        parser->mem, parser->root->as.document.html_filters, tmp->data);
 
   return parser->root;
 }
@@ -736,11 +1131,184 @@ void cmark_parser_feed_reentrant(cmark_parser *parser, const char *buffer, size_
   cmark_strbuf_free(&saved_linebuf);
 }
 
+// The length of 'buffer' without a UTF-8 sequence cut off at its end,
+// which the next buffer completes unless this is the last one.  The
+// unfinished line it belongs to is kept in linebuf in the meantime.
+static size_t S_utf8_complete_len(const unsigned char *buffer, size_t len,
+                                  bool eof) {
+  size_t k;
+
+  if (eof)
+    return len;
+
+  for (k = 1; k <= 3 && k <= len; ++k) {
+    unsigned char c = buffer[len - k];
+    if (c < 0x80)
+      break;
+    if (c >= 0xC0) {
+      // Lead byte of a sequence of 2, 3 or 4 bytes.
+      if ((size_t)(c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : 2) > k)
+        return len - k;
+      break;
+    }
+  }
+
+  return len;
+}
+
+// Return true if the line from 'p' to 'eol' could close a fenced code
+// block of 'fence_char'.
+static bool S_may_close_fence(const unsigned char *p, const unsigned char *eol,
+                              unsigned char fence_char) {
+  const unsigned char *q = p;
+
+  while (q < eol && q - p < 3 && *q == ' ')
+    q++;
+  return q < eol && *q == fence_char;
+}
+
+// Return true if the line from 'p' to 'eol' could end an HTML block of
+// type 1 to 5, or is blank.  All the end conditions end in a '>'.
+static bool S_may_end_html_block(int html_block_type, const unsigned char *p,
+                                 const unsigned char *eol) {
+  static const char *const tags[] = {"script", "pre", "textarea", "style"};
+  const unsigned char *q = p, *tag;
+  size_t i, j, n;
+
+  while (q < eol && S_is_space_or_tab(*q))
+    q++;
+  if (q == eol)
+    return true;
+
+  while ((q = (const unsigned char *)memchr(q, '>', eol - q)) != NULL) {
+    switch (html_block_type) {
+    case 1:
+      for (i = 0; i < sizeof(tags) / sizeof(tags[0]); i++) {
+        n = strlen(tags[i]);
+        if ((size_t)(q - p) < n + 2)
+          continue;
+        tag = q - n;
+        if (tag[-2] != '<' || tag[-1] != '/')
+          continue;
+        // The tags are letters, which only differ from their
+        // uppercase forms in the 0x20 bit.
+        for (j = 0; j < n && (tag[j] | 0x20) == tags[i][j]; j++)
+          ;
+        if (j == n)
+          return true;
+      }
+      break;
+    case 2:
+      if (q - p >= 2 && q[-2] == '-' && q[-1] == '-')
+        return true;
+      break;
+    case 3:
+      if (q - p >= 1 && q[-1] == '?')
+        return true;
+      break;
+    case 4:
+      return true;
+    case 5:
+      if (q - p >= 2 && q[-2] == ']' && q[-1] == ']')
+        return true;
+      break;
+    }
+    q++;
+  }
+  return false;
+}
+
+// Add the lines at 'buffer' to a block at the top level that is the
+// current block and takes its lines as they are, a fenced code block or an
+// HTML block of type 1 to 5, up to the next line that could end it, and
+// return the end of the lines added.  Such lines need no prefix matching,
+// so they are found with memchr and added at once.  Lines ending in a CR or
+// holding a NUL, which S_parser_feed rewrites, and unfinished lines are
+// left to S_process_line, as is any code block indented like its fence,
+// whose lines lose that indent, and blank lines in HTML blocks, which
+// leave flags for S_process_line to clear on the next line.
+static const unsigned char *S_feed_raw_lines(cmark_parser *parser,
+                                             const unsigned char *buffer,
+                                             const unsigned char *end) {
+  cmark_node *node = parser->current;
+  const unsigned char *p = buffer, *q, *eol, *cut;
+  unsigned char fence_char = 0;
+  int html_block_type = 0;
+  bufsize_t lines = 0, last_len = 0, max_lines = INT_MAX;
+  cmark_chunk input;
+
+  if (node->parent != parser->root)
+    return buffer;
+
+  switch (S_type(node)) {
+  case CMARK_NODE_CODE_BLOCK:
+    if (!node->as.code.fenced || node->as.code.fence_offset != 0)
+      return buffer;
+    fence_char = node->as.code.fence_char;
+    break;
+  case CMARK_NODE_HTML_BLOCK:
+    if (node->as.html_block_type > 5 || S_last_line_blank(node))
+      return buffer;
+    html_block_type = node->as.html_block_type;
+    break;
+  default:
+    return buffer;
+  }
+
+  // Check for cancellation as often as line by line.
+  if (parser->cancel_func || parser->over_budget)
+    max_lines = parser->cancel_countdown > 0 ? parser->cancel_countdown : 1;
+
+  while (lines < max_lines) {
+    eol = (const unsigned char *)memchr(p, '\n', end - p);
+    if (eol == NULL ||
+        (fence_char ? S_may_close_fence(p, eol, fence_char)
+                    : S_may_end_html_block(html_block_type, p, eol)))
+      break;
+    last_len = (bufsize_t)(eol - p);
+    p = eol + 1;
+    lines++;
+  }
+
+  cut = (const unsigned char *)memchr(buffer, '\r', p - buffer);
+  q = (const unsigned char *)memchr(buffer, '\0', (cut ? cut : p) - buffer);
+  if (q)
+    cut = q;
+  if (cut) {
+    // Count the lines again up to the one with the CR or NUL.
+    for (p = buffer, lines = 0;
+         (eol = (const unsigned char *)memchr(p, '\n', cut - p)); lines++) {
+      last_len = (bufsize_t)(eol - p);
+      p = eol + 1;
+    }
+  }
+  if (lines == 0)
+    return buffer;
+
+  if (max_lines != INT_MAX) {
+    parser->cancel_countdown -= lines - 1;
+    if (cmark_parser_check_cancel(parser))
+      return buffer;
+  }
+
+  input.data = (unsigned char *)buffer;
+  input.len = (bufsize_t)(p - buffer);
+  input.alloc = 0;
+  parser->offset = 0;
+  parser->partially_consumed_tab = false;
+  add_line(node, &input, parser);
+
+  parser->line_number += lines;
+  parser->last_line_length = last_len;
+  return p;
+}
+
 static void S_parser_feed(cmark_parser *parser, const unsigned char *buffer,
                           size_t len, bool eof) {
   const unsigned char *end = buffer + len;
   static const uint8_t repl[] = {239, 191, 189};
   bool preserveWhitespace = parser->options & CMARK_OPT_PRESERVE_WHITESPACE;
+  bool validUTF8;
 
   if (len > UINT_MAX - parser->total_size)
     parser->total_size = UINT_MAX;
@@ -752,10 +1320,31 @@ static void S_parser_feed(cmark_parser *parser, const unsigned char *buffer,
     buffer++;
   }
   parser->last_buffer_ended_with_cr = false;
-  while (buffer < end) {
+
+  if (parser->cancelled)
+    return;
+
+  // Validate the whole buffer at once: lines taken straight from a valid
+  // buffer don't need cmark_utf8proc_check.  Lines that started in an
+  // earlier buffer still go through it.
+  validUTF8 = (parser->options & CMARK_OPT_VALIDATE_UTF8) &&
+              cmark_utf8proc_is_valid(
+                  buffer, S_utf8_complete_len(buffer, (size_t)(end - buffer), eof));
+
+  while (buffer < end && !parser->cancelled) {
     const unsigned char *eol;
     bufsize_t chunk_len;
     bool process = false;
+
+    if ((S_type(parser->current) == CMARK_NODE_CODE_BLOCK ||
+         S_type(parser->current) == CMARK_NODE_HTML_BLOCK) &&
+        parser->linebuf.size == 0 &&
+        (validUTF8 || !(parser->options & CMARK_OPT_VALIDATE_UTF8))) {
+      buffer = S_feed_raw_lines(parser, buffer, end);
+      if (buffer == end || parser->cancelled)
+        break;
+    }
+
     for (eol = buffer; eol < end; ++eol) {
       if (S_is_line_end_char(*eol)) {
         process = true;
@@ -773,10 +1362,10 @@ static void S_parser_feed(cmark_parser *parser, const unsigned char *buffer,
     if (process) {
       if (parser->linebuf.size > 0) {
         cmark_strbuf_put(&parser->linebuf, buffer, chunk_len);
-        S_process_line(parser, parser->linebuf.ptr, parser->linebuf.size, !preserveWhitespace || !eof || eol < end);
+        S_process_line(parser, parser->linebuf.ptr, parser->linebuf.size, !preserveWhitespace || !eof || eol < end, false);
         cmark_strbuf_clear(&parser->linebuf);
       } else {
-        S_process_line(parser, buffer, chunk_len, !preserveWhitespace || !eof || eol < end);
+        S_process_line(parser, buffer, chunk_len, !preserveWhitespace || !eof || eol < end, validUTF8);
       }
     } else {
       if (eol < end && *eol == '\0') {
@@ -1074,19 +1663,18 @@ static bool parse_extension_block(cmark_parser *parser,
  * Will not close unmatched blocks, as we may have a lazy continuation
  * line -> http://spec.commonmark.org/0.24/#lazy-continuation-line
  *
- * Returns: The last matching node, or NULL
+ * Returns: The last matching node, or NULL, and its depth in 'depth'
  */
 static cmark_node *check_open_blocks(cmark_parser *parser, cmark_chunk *input,
-                                     bool *all_matched) {
+                                     bool *all_matched, bufsize_t *depth) {
   bool should_continue = true;
   *all_matched = false;
   cmark_node *container = parser->root;
   cmark_node_type cont_type;
-    
-    
+  bufsize_t i = 0;
 
-  while (S_last_child_is_open(container)) {
-    container = container->last_child;
+  while (i + 1 < parser->num_open_blocks) {
+    container = parser->open_blocks[++i];
     cont_type = S_type(container);
 
     S_find_first_nonspace(parser, input);
@@ -1135,8 +1723,11 @@ static cmark_node *check_open_blocks(cmark_parser *parser, cmark_chunk *input,
 done:
   if (!*all_matched) {
     container = container->parent; // back up to last matching node
+    i--;
   }
 
+  *depth = i;
+
   if (!should_continue) {
     container = NULL;
   }
@@ -1147,7 +1738,7 @@ done:
 static void open_new_blocks(cmark_parser *parser, cmark_node **container,
                             cmark_chunk *input, bool all_matched) {
   bool indented;
-  cmark_list *data = NULL;
+  cmark_list data;
   bool maybe_lazy = S_type(parser->current) == CMARK_NODE_PARAGRAPH;
   cmark_node_type cont_type = S_type(*container);
   bufsize_t matched = 0;
@@ -1157,14 +1748,27 @@ static void open_new_blocks(cmark_parser *parser, cmark_node **container,
   int save_offset;
   int save_column;
   size_t depth = 0;
+  unsigned starts;
+  bool own_extension;
 
   while (cont_type != CMARK_NODE_CODE_BLOCK &&
          cont_type != CMARK_NODE_HTML_BLOCK) {
     depth++;
     S_find_first_nonspace(parser, input);
     indented = parser->indent >= CODE_INDENT;
+    starts = parser->block_starts[(unsigned char)peek_at(input, parser->first_nonspace)];
+
+    // An extension is always asked whether a line opens a block in a
+    // container it created, whatever the line starts with.
+    own_extension = (*container)->extension &&
+                    (*container)->extension->try_opening_block;
 
-    if (!indented && peek_at(input, parser->first_nonspace) == '>') {
+    if (!indented && !starts && !own_extension) {
+      // Most likely a paragraph line.
+      break;
+    }
+
+    if (!indented && (starts & BLOCK_START_QUOTE)) {
 
       bufsize_t blockquote_startpos = parser->first_nonspace;
 
@@ -1177,7 +1781,8 @@ static void open_new_blocks(cmark_parser *parser, cmark_node **container,
       *container = add_child(parser, *container, CMARK_NODE_BLOCK_QUOTE,
                              blockquote_startpos + 1);
 
-    } else if (!indented && (matched = scan_atx_heading_start(
+    } else if (!indented && (starts & BLOCK_START_ATX) &&
+               (matched = scan_atx_heading_start(
                                  input, parser->first_nonspace))) {
       bufsize_t hashpos;
       int level = 0;
@@ -1200,7 +1805,8 @@ static void open_new_blocks(cmark_parser *parser, cmark_node **container,
       (*container)->as.heading.setext = false;
       (*container)->internal_offset = matched;
 
-    } else if (!indented && (matched = scan_open_code_fence(
+    } else if (!indented && (starts & BLOCK_START_FENCE) &&
+               (matched = scan_open_code_fence(
                                  input, parser->first_nonspace))) {
       *container = add_child(parser, *container, CMARK_NODE_CODE_BLOCK,
                              parser->first_nonspace + 1);
@@ -1214,7 +1820,8 @@ static void open_new_blocks(cmark_parser *parser, cmark_node **container,
                        parser->first_nonspace + matched - parser->offset,
                        false);
 
-    } else if (!indented && ((matched = scan_html_block_start(
+    } else if (!indented && (starts & BLOCK_START_HTML) &&
+               ((matched = scan_html_block_start(
                                   input, parser->first_nonspace)) ||
                              (cont_type != CMARK_NODE_PARAGRAPH &&
                               (matched = scan_html_block_start_7(
@@ -1224,11 +1831,14 @@ static void open_new_blocks(cmark_parser *parser, cmark_node **container,
       (*container)->as.html_block_type = matched;
       // note, we don't adjust parser->offset because the tag is part of the
       // text
-    } else if (!indented && cont_type == CMARK_NODE_PARAGRAPH &&
+    } else if (!indented && (starts & BLOCK_START_SETEXT) &&
+               cont_type == CMARK_NODE_PARAGRAPH &&
                (lev =
                     scan_setext_heading_line(input, parser->first_nonspace))) {
       // finalize paragraph, resolving reference links
-      has_content = resolve_reference_link_definitions(parser, *container);
+      cmark_strbuf_drop(&(*container)->content,
+                        resolve_reference_link_definitions(parser, *container));
+      has_content = !is_blank(&(*container)->content, 0);
 
       if (has_content) {
 
@@ -1237,7 +1847,7 @@ static void open_new_blocks(cmark_parser *parser, cmark_node **container,
         (*container)->as.heading.setext = true;
         S_advance_offset(parser, input, input->len - 1 - parser->offset, false);
       }
-    } else if (!indented &&
+    } else if (!indented && (starts & BLOCK_START_THEMATIC_BREAK) &&
                !(cont_type == CMARK_NODE_PARAGRAPH && !all_matched) &&
 	       (parser->thematic_break_kill_pos <= parser->first_nonspace) &&
                (matched = S_scan_thematic_break(parser, input, parser->first_nonspace))) {
@@ -1245,7 +1855,7 @@ static void open_new_blocks(cmark_parser *parser, cmark_node **container,
       *container = add_child(parser, *container, CMARK_NODE_THEMATIC_BREAK,
                              parser->first_nonspace + 1);
       S_advance_offset(parser, input, input->len - 1 - parser->offset, false);
-    } else if (!indented &&
+    } else if (!indented && (starts & BLOCK_START_FOOTNOTE) &&
                (parser->options & CMARK_OPT_FOOTNOTES) &&
                depth < MAX_LIST_DEPTH &&
                (matched = scan_footnote_definition(input, parser->first_nonspace))) {
@@ -1262,11 +1872,12 @@ static void open_new_blocks(cmark_parser *parser, cmark_node **container,
       (*container)->as.literal = c;
 
       (*container)->internal_offset = matched;
-    } else if ((!indented || cont_type == CMARK_NODE_LIST) &&
+    } else if ((starts & BLOCK_START_LIST) &&
+               (!indented || cont_type == CMARK_NODE_LIST) &&
 	       parser->indent < 4 &&
                depth < MAX_LIST_DEPTH &&
                (matched = parse_list_marker(
-                    parser->mem, input, parser->first_nonspace,
+                    input, parser->first_nonspace,
                     (*container)->type == CMARK_NODE_PARAGRAPH, &data))) {
 
       // Note that we can have new list items starting with >= 4
@@ -1291,7 +1902,7 @@ static void open_new_blocks(cmark_parser *parser, cmark_node **container,
       if (i >= 5 || i < 1 ||
           // only spaces after list marker:
           S_is_line_end_char(peek_at(input, parser->offset))) {
-        data->padding = matched + 1;
+        data.padding = matched + 1;
         parser->offset = save_offset;
         parser->column = save_column;
         parser->partially_consumed_tab = save_partially_consumed_tab;
@@ -1299,28 +1910,26 @@ static void open_new_blocks(cmark_parser *parser, cmark_node **container,
           S_advance_offset(parser, input, 1, true);
         }
       } else {
-        data->padding = matched + i;
+        data.padding = matched + i;
       }
 
       // check container; if it's a list, see if this list item
       // can continue the list; otherwise, create a list container.
 
-      data->marker_offset = parser->indent;
+      data.marker_offset = parser->indent;
 
       if (cont_type != CMARK_NODE_LIST ||
-          !lists_match(&((*container)->as.list), data)) {
+          !lists_match(&((*container)->as.list), &data)) {
         *container = add_child(parser, *container, CMARK_NODE_LIST,
                                parser->first_nonspace + 1);
 
-        memcpy(&((*container)->as.list), data, sizeof(*data));
+        (*container)->as.list = data;
       }
 
       // add the list item
       *container = add_child(parser, *container, CMARK_NODE_ITEM,
                              parser->first_nonspace + 1);
-      /* TODO: static */
-      memcpy(&((*container)->as.list), data, sizeof(*data));
-      parser->mem->free(data);
+      (*container)->as.list = data;
     } else if (indented && !maybe_lazy && !parser->blank) {
       S_advance_offset(parser, input, CODE_INDENT, true);
       *container = add_child(parser, *container, CMARK_NODE_CODE_BLOCK,
@@ -1330,14 +1939,16 @@ static void open_new_blocks(cmark_parser *parser, cmark_node **container,
       (*container)->as.code.fence_length = 0;
       (*container)->as.code.fence_offset = 0;
       (*container)->as.code.info = cmark_chunk_literal("");
-    } else {
-      cmark_llist *tmp;
+    } else if ((starts & BLOCK_START_EXTENSION) || own_extension) {
+      cmark_syntax_extension **exts;
       cmark_node *new_container = NULL;
+      unsigned char c = peek_at(input, parser->first_nonspace);
 
-      for (tmp = parser->syntax_extensions; tmp; tmp=tmp->next) {
-        cmark_syntax_extension *ext = (cmark_syntax_extension *) tmp->data;
+      for (exts = parser->block_extensions; *exts; exts++) {
+        cmark_syntax_extension *ext = *exts;
 
-        if (ext->try_opening_block) {
+        if (!ext->block_start_chars || ext->block_start_table[c] ||
+            ext == (*container)->extension) {
           new_container = ext->try_opening_block(
               ext, indented, parser, *container, input->data, input->len);
 
@@ -1351,6 +1962,8 @@ static void open_new_blocks(cmark_parser *parser, cmark_node **container,
       if (!new_container) {
         break;
       }
+    } else {
+      break;
     }
 
     if (accepts_lines(S_type(*container))) {
@@ -1365,8 +1978,10 @@ static void open_new_blocks(cmark_parser *parser, cmark_node **container,
 
 static void add_text_to_container(cmark_parser *parser, cmark_node *container,
                                   cmark_node *last_matched_container,
+                                  bufsize_t matched_depth,
                                   cmark_chunk *input) {
-  cmark_node *tmp;
+  cmark_node *tmp, *stop;
+  bufsize_t depth, steps = 0;
   // what remains at parser->offset is a text line.  add the text to the
   // appropriate container.
 
@@ -1389,12 +2004,27 @@ static void add_text_to_container(cmark_parser *parser, cmark_node *container,
 
   S_set_last_line_blank(container, last_line_blank);
 
+  // Clear the flag on the ancestors of the container, up to the ones that
+  // can't have it set. The blocks above the last matched container are
+  // still in the tree, so 'stop' is only reached if it is an ancestor.
+  depth = MIN(parser->blank_depth, matched_depth) - 1;
+  stop = depth >= 0 ? parser->open_blocks[depth] : NULL;
   tmp = container;
-  while (tmp->parent) {
+  while (tmp->parent && tmp != stop) {
     S_set_last_line_blank(tmp->parent, false);
     tmp = tmp->parent;
+    steps++;
   }
 
+  // Now only the container and the blocks below it can have the flag set.
+  depth = (tmp == stop ? depth : 0) + steps;
+  if (parser->blank_depth < depth)
+    parser->blank_depth = depth;
+  if (last_line_blank)
+    parser->blank_depth = depth;
+  else if (parser->blank && container->last_child)
+    parser->blank_depth = MIN(parser->blank_depth, depth + 1);
+
   // If the last line processed belonged to a paragraph node,
   // and we didn't match all of the line prefixes for the open containers,
   // and we didn't start any new containers,
@@ -1482,18 +2112,51 @@ static void add_text_to_container(cmark_parser *parser, cmark_node *container,
   }
 }
 
+// Bring parser->open_blocks up to date once a line is processed. The
+// blocks above the last matched container at 'depth' are still in place,
+// unless they were closed to make room for a new block, so it is enough to
+// back up to the deepest one that is still open and the last child of its
+// parent, and follow the open last children from there.
+static void S_update_open_blocks(cmark_parser *parser, bufsize_t depth) {
+  cmark_node **blocks = parser->open_blocks;
+  cmark_node *node;
+
+  if (depth > parser->num_open_blocks - 1)
+    depth = parser->num_open_blocks - 1;
+  while (depth > 0 && !(blocks[depth - 1]->last_child == blocks[depth] &&
+                        (blocks[depth]->flags & CMARK_NODE__OPEN)))
+    depth--;
+
+  node = blocks[depth];
+  while (S_last_child_is_open(node)) {
+    node = node->last_child;
+    if (++depth == parser->open_blocks_size) {
+      parser->open_blocks_size *= 2;
+      blocks = parser->open_blocks = (cmark_node **)parser->mem->realloc(
+          blocks, parser->open_blocks_size * sizeof(cmark_node *));
+    }
+    blocks[depth] = node;
+  }
+  parser->num_open_blocks = depth + 1;
+}
+
 /* See http://spec.commonmark.org/0.24/#phase-1-block-structure */
 static void S_process_line(cmark_parser *parser, const unsigned char *buffer,
-                           bufsize_t bytes, bool ensureEndsInNewline) {
+                           bufsize_t bytes, bool ensureEndsInNewline,
+                           bool validUTF8) {
   cmark_node *last_matched_container;
   bool all_matched = true;
   cmark_node *container;
   cmark_chunk input;
   cmark_node *current;
+  bufsize_t matched_depth;
+
+  if (cmark_parser_check_cancel(parser))
+    return;
 
   cmark_strbuf_clear(&parser->curline);
 
-  if (parser->options & CMARK_OPT_VALIDATE_UTF8)
+  if ((parser->options & CMARK_OPT_VALIDATE_UTF8) && !validUTF8)
     cmark_utf8proc_check(&parser->curline, buffer, bytes);
   else
     cmark_strbuf_put(&parser->curline, buffer, bytes);
@@ -1525,7 +2188,8 @@ static void S_process_line(cmark_parser *parser, const unsigned char *buffer,
 
   parser->line_number++;
 
-  last_matched_container = check_open_blocks(parser, &input, &all_matched);
+  last_matched_container =
+      check_open_blocks(parser, &input, &all_matched, &matched_depth);
 
   if (!last_matched_container)
     goto finished;
@@ -1540,9 +2204,12 @@ static void S_process_line(cmark_parser *parser, const unsigned char *buffer,
 
   /* parser->current might have changed if feed_reentrant was called */
   if (current == parser->current)
-  add_text_to_container(parser, container, last_matched_container, &input);
+  add_text_to_container(parser, container, last_matched_container,
+                        matched_depth, &input);
 
 finished:
+  S_update_open_blocks(parser, matched_depth);
+
   parser->last_line_length = input.len;
   if (parser->last_line_length &&
       input.data[parser->last_line_length - 1] == '\n')
@@ -1563,29 +2230,41 @@ cmark_node *cmark_parser_finish(cmark_parser *parser) {
     return NULL;
 
   if (parser->linebuf.size) {
-    S_process_line(parser, parser->linebuf.ptr, parser->linebuf.size, (parser->options & CMARK_OPT_PRESERVE_WHITESPACE) == 0);
+    S_process_line(parser, parser->linebuf.ptr, parser->linebuf.size, (parser->options & CMARK_OPT_PRESERVE_WHITESPACE) == 0, false);
     cmark_strbuf_clear(&parser->linebuf);
   }
 
-  finalize_document(parser);
+  if (!parser->cancelled)
+    finalize_document(parser);
 
-  cmark_consolidate_text_nodes(parser->root);
+  // Text nodes were consolidated by finalize_document in an eager parse; in
+  // a lazy one consolidation and postprocessing happen block by block, as
+  // the inlines get parsed.
+  if (S_lazy_inlines(parser) && !parser->cancelled)
+    attach_inline_parser(parser);
 
-  cmark_strbuf_free(&parser->curline);
   cmark_strbuf_free(&parser->linebuf);
 
+  if (parser->cancelled) {
+    // Frees the partial document.
+    cmark_parser_reset(parser);
+    return NULL;
+  }
+
 #if CMARK_DEBUG_NODES
   if (cmark_node_check(parser->root, stderr)) {
     abort();
   }
 #endif
 
-  for (extensions = parser->syntax_extensions; extensions; extensions = extensions->next) {
-    cmark_syntax_extension *ext = (cmark_syntax_extension *) extensions->data;
-    if (ext->postprocess_func) {
-      cmark_node *processed = ext->postprocess_func(ext, parser, parser->root);
-      if (processed)
-        parser->root = processed;
+  if (!S_lazy_inlines(parser)) {
+    for (extensions = parser->syntax_extensions; extensions; extensions = extensions->next) {
+      cmark_syntax_extension *ext = (cmark_syntax_extension *) extensions->data;
+      if (ext->postprocess_func) {
+        cmark_node *processed = ext->postprocess_func(ext, parser, parser->root);
+        if (processed)
+          parser->root = processed;
+      }
     }
   }
 
@@ -1597,6 +2276,52 @@ cmark_node *cmark_parser_finish(cmark_parser *parser) {
   return res;
 }
 
+char *cmark_parser_render_html_batch(cmark_parser *parser,
+                                     const char *const *texts,
+                                     const size_t *lens, size_t n,
+                                     size_t *offsets) {
+  cmark_llist *filter_extensions =
+      cmark_html_filter_extensions(parser->mem, parser->syntax_extensions);
+  cmark_strbuf result, html;
+  cmark_node *document;
+  size_t i;
+
+  cmark_strbuf_init(parser->mem, &result, 0);
+  // Each string is rendered on its own first, since the HTML renderer
+  // looks at what comes before the output.
+  cmark_strbuf_init(parser->mem, &html, 0);
+
+  for (i = 0; i < n; ++i) {
+    S_parser_feed(parser, (const unsigned char *)texts[i], lens[i], true);
+    document = cmark_parser_finish(parser);
+
+    offsets[i] = (size_t)result.size;
+    if (document) {
+      cmark_strbuf_clear(&html);
+      cmark_html_render_to(&html, document, parser->options,
+                           filter_extensions);
+      cmark_strbuf_put(&result, html.ptr, html.size);
+      cmark_node_free(document);
+    }
+    cmark_strbuf_putc(&result, '\0');
+  }
+
+  cmark_strbuf_free(&html);
+  cmark_llist_free(parser->mem, filter_extensions);
+  return (char *)cmark_strbuf_detach(&result);
+}
+
+void cmark_parser_set_cancel_func(cmark_parser *parser,
+                                  cmark_parser_cancel_func func, void *data) {
+  parser->cancel_func = func;
+  parser->cancel_data = data;
+  parser->cancel_countdown = CMARK_CANCEL_INTERVAL;
+}
+
+int cmark_parser_is_cancelled(cmark_parser *parser) {
+  return parser->cancelled;
+}
+
 int cmark_parser_get_line_number(cmark_parser *parser) {
   return parser->line_number;
 }
@@ -26,8 +26,10 @@ void cmark_strbuf_init(cmark_mem *mem, cmark_strbuf *buf,
   buf->size = 0;
   buf->ptr = cmark_strbuf__initbuf;
 
-  if (initial_size > 0)
+  if (initial_size > 0) {
     cmark_strbuf_grow(buf, initial_size);
+    buf->ptr[0] = '\0';
+  }
 }
 
 static inline void S_strbuf_grow_by(cmark_strbuf *buf, bufsize_t add) {
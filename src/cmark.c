@@ -53,3 +53,15 @@ char *cmark_markdown_to_html(const char *text, size_t len, int options) {
 
   return result;
 }
+
+char *cmark_markdown_to_html_batch(const char *const *texts,
+                                   const size_t *lens, size_t n, int options,
+                                   size_t *offsets) {
+  cmark_parser *parser = cmark_parser_new(options | CMARK_OPT_INLINE_ONLY);
+  char *result;
+
+  result = cmark_parser_render_html_batch(parser, texts, lens, n, offsets);
+  cmark_parser_free(parser);
+
+  return result;
+}
@@ -13,6 +13,9 @@
 #include "render.h"
 #include "syntax_extension.h"
 
+// Average number of bytes of markup each node adds to the CommonMark output.
+#define COMMONMARK_BYTES_PER_NODE 2
+
 #define OUT(s, wrap, escaping) renderer->out(renderer, node, s, wrap, escaping)
 #define LIT(s) renderer->out(renderer, node, s, false, LITERAL)
 #define CR() renderer->cr(renderer)
@@ -515,10 +518,27 @@ char *cmark_render_commonmark(cmark_node *root, int options, int width) {
 }
 
 char *cmark_render_commonmark_with_mem(cmark_node *root, int options, int width, cmark_mem *mem) {
+  return cmark_render_commonmark_with_mem_and_capacity(root, options, width, mem, 0);
+}
+
+cmark_render_sink *cmark_commonmark_sink_new(cmark_mem *mem, cmark_node *root,
+                                             int options, int width,
+                                             size_t capacity) {
   if (options & CMARK_OPT_HARDBREAKS) {
     // disable breaking on width, since it has
     // a different meaning with OPT_HARDBREAKS
     width = 0;
   }
-  return cmark_render(mem, root, options, width, outc, S_render_node);
+  return cmark_render_sink_new(
+      mem, options, width,
+      cmark_render_size_hint(root, capacity, COMMONMARK_BYTES_PER_NODE), outc,
+      S_render_node);
+}
+
+char *cmark_render_commonmark_with_mem_and_capacity(cmark_node *root,
+                                                    int options, int width,
+                                                    cmark_mem *mem,
+                                                    size_t capacity) {
+  return cmark_render_sink_run(
+      root, cmark_commonmark_sink_new(mem, root, options, width, capacity));
 }
@@ -18,32 +18,21 @@
 #define likely(e) __builtin_expect((e), 1)
 #define unlikely(e) __builtin_expect((e), 0)
 
-/* Binary tree lookup code for entities added by JGM */
-
-static const unsigned char *S_lookup(int i, int low, int hi,
-                                     const unsigned char *s, int len) {
-  int j;
-  int cmp =
-      strncmp((const char *)s, (const char *)cmark_entities[i].entity, len);
-  if (cmp == 0 && cmark_entities[i].entity[len] == 0) {
-    return (const unsigned char *)cmark_entities[i].bytes;
-  } else if (cmp <= 0 && i > low) {
-    j = i - ((i - low) / 2);
-    if (j == i)
-      j -= 1;
-    return S_lookup(j, low, i - 1, s, len);
-  } else if (cmp > 0 && i < hi) {
-    j = i + ((hi - i) / 2);
-    if (j == i)
-      j += 1;
-    return S_lookup(j, i + 1, hi, s, len);
-  } else {
-    return NULL;
-  }
-}
+/* Perfect hash lookup: the tables in entities.inc place every entity
+ * name in its own slot, so a name either matches the entry in its slot
+ * or is not an entity.  See tools/make_entities_inc.py. */
 
 static const unsigned char *S_lookup_entity(const unsigned char *s, int len) {
-  return S_lookup(CMARK_NUM_ENTITIES / 2, 0, CMARK_NUM_ENTITIES - 1, s, len);
+  uint32_t h = cmark_entity_hash(s, len);
+  int32_t d = cmark_entity_displacements[h % CMARK_ENTITY_BUCKETS];
+  uint32_t slot = d < 0 ? (uint32_t)(-d - 1)
+                        : cmark_entity_mix(h ^ (uint32_t)d) % CMARK_NUM_ENTITIES;
+  const struct cmark_entity_node *ent = &cmark_entities[slot];
+
+  if (strncmp((const char *)s, (const char *)ent->entity, len) == 0 &&
+      ent->entity[len] == 0)
+    return (const unsigned char *)ent->bytes;
+  return NULL;
 }
 
 bufsize_t houdini_unescape_ent(cmark_strbuf *ob, const uint8_t *src,
@@ -10,8 +10,12 @@
 #include "scanners.h"
 #include "syntax_extension.h"
 #include "html.h"
+#include "iterator.h"
 #include "render.h"
 
+// Average number of bytes of tags each node adds to the HTML output.
+#define HTML_BYTES_PER_NODE 8
+
 // Functions to convert cmark_nodes to HTML strings.
 
 static void escape_html(cmark_strbuf *dest, const unsigned char *source,
@@ -19,11 +23,23 @@ static void escape_html(cmark_strbuf *dest, const unsigned char *source,
   houdini_escape_html0(dest, source, length, 0);
 }
 
-static void filter_html_block(cmark_html_renderer *renderer, uint8_t *data, size_t len) {
-  cmark_strbuf *html = renderer->html;
+// Whether one of 'filter_extensions' rejects the tag at the start of 'data'.
+static bool S_filtered(cmark_llist *filter_extensions, const uint8_t *data,
+                       size_t len) {
   cmark_llist *it;
   cmark_syntax_extension *ext;
-  bool filtered;
+
+  for (it = filter_extensions; it; it = it->next) {
+    ext = ((cmark_syntax_extension *) it->data);
+    if (!ext->html_filter_func(ext, data, len))
+      return true;
+  }
+
+  return false;
+}
+
+static void filter_html_block(cmark_html_renderer *renderer, uint8_t *data, size_t len) {
+  cmark_strbuf *html = renderer->html;
   uint8_t *match;
 
   while (len) {
@@ -37,16 +53,7 @@ static void filter_html_block(cmark_html_renderer *renderer, uint8_t *data, size
       data = match;
     }
 
-    filtered = false;
-    for (it = renderer->filter_extensions; it; it = it->next) {
-      ext = ((cmark_syntax_extension *) it->data);
-      if (!ext->html_filter_func(ext, data, len)) {
-        filtered = true;
-        break;
-      }
-    }
-
-    if (!filtered) {
+    if (!S_filtered(renderer->filter_extensions, data, len)) {
       cmark_strbuf_putc(html, '<');
     } else {
       cmark_strbuf_puts(html, "&lt;");
@@ -60,6 +67,40 @@ static void filter_html_block(cmark_html_renderer *renderer, uint8_t *data, size
     cmark_strbuf_put(html, data, (bufsize_t)len);
 }
 
+void cmark_html_classify(cmark_llist *filter_extensions, cmark_node *node) {
+  const uint8_t *data = node->as.literal.data;
+  size_t len = node->as.literal.len;
+  const uint8_t *match;
+
+  node->flags &= ~CMARK_NODE__HTML_UNFILTERED;
+  if (!filter_extensions)
+    return;
+
+  if (node->type == CMARK_NODE_HTML_INLINE) {
+    // Only the tag the inline starts with is filtered.
+    if (len && S_filtered(filter_extensions, data, len))
+      return;
+  } else {
+    while (len && (match = (const uint8_t *) memchr(data, '<', len))) {
+      len -= (match - data);
+      data = match;
+      if (S_filtered(filter_extensions, data, len))
+        return;
+      ++data;
+      --len;
+    }
+  }
+
+  node->flags |= CMARK_NODE__HTML_UNFILTERED;
+}
+
+// Whether the raw HTML of 'node' can be output without running the filters
+// again: it was classified when parsed with at least the renderer's filters.
+static bool S_unfiltered(cmark_html_renderer *renderer, cmark_node *node) {
+  return renderer->filters_classified &&
+         (node->flags & CMARK_NODE__HTML_UNFILTERED) != 0;
+}
+
 static bool S_put_footnote_backref(cmark_html_renderer *renderer, cmark_strbuf *html, cmark_node *node) {
   if (renderer->written_footnote_ix >= renderer->footnote_ix)
     return false;
@@ -107,12 +148,9 @@ static int S_render_node(cmark_html_renderer *renderer, cmark_node *node,
   cmark_node *parent;
   cmark_node *grandparent;
   cmark_strbuf *html = renderer->html;
-  cmark_llist *it;
-  cmark_syntax_extension *ext;
   char start_heading[] = "<h0";
   char end_heading[] = "</h0";
   bool tight;
-  bool filtered;
   char buffer[BUFFER_SIZE];
 
   bool entering = (ev_type == CMARK_EVENT_ENTER);
@@ -258,7 +296,7 @@ static int S_render_node(cmark_html_renderer *renderer, cmark_node *node,
     cmark_html_render_cr(html);
     if (!(options & CMARK_OPT_UNSAFE)) {
       cmark_strbuf_puts(html, "<!-- raw HTML omitted -->");
-    } else if (renderer->filter_extensions) {
+    } else if (renderer->filter_extensions && !S_unfiltered(renderer, node)) {
       filter_html_block(renderer, node->as.literal.data, node->as.literal.len);
     } else {
       cmark_strbuf_put(html, node->as.literal.data, node->as.literal.len);
@@ -337,15 +375,9 @@ static int S_render_node(cmark_html_renderer *renderer, cmark_node *node,
     if (!(options & CMARK_OPT_UNSAFE)) {
       cmark_strbuf_puts(html, "<!-- raw HTML omitted -->");
     } else {
-      filtered = false;
-      for (it = renderer->filter_extensions; it; it = it->next) {
-        ext = (cmark_syntax_extension *) it->data;
-        if (!ext->html_filter_func(ext, node->as.literal.data, node->as.literal.len)) {
-          filtered = true;
-          break;
-        }
-      }
-      if (!filtered) {
+      if (S_unfiltered(renderer, node) ||
+          !S_filtered(renderer->filter_extensions, node->as.literal.data,
+                      node->as.literal.len)) {
         cmark_strbuf_put(html, node->as.literal.data, node->as.literal.len);
       } else {
         cmark_strbuf_puts(html, "&lt;");
@@ -466,7 +498,9 @@ static int S_render_node(cmark_html_renderer *renderer, cmark_node *node,
       }
 
       cmark_strbuf_puts(html, "\" data-footnote-ref>");
-      houdini_escape_href(html, node->as.literal.data, node->as.literal.len);
+      char ix[32];
+      snprintf(ix, sizeof(ix), "%d", node->footnote_ix);
+      cmark_strbuf_puts(html, ix);
       cmark_strbuf_puts(html, "</a></sup>");
     }
     break;
@@ -484,33 +518,119 @@ char *cmark_render_html(cmark_node *root, int options, cmark_llist *extensions)
 }
 
 char *cmark_render_html_with_mem(cmark_node *root, int options, cmark_llist *extensions, cmark_mem *mem) {
+  return cmark_render_html_with_mem_and_capacity(root, options, extensions, mem, 0);
+}
+
+typedef struct {
+  cmark_render_sink sink;
+  cmark_html_renderer renderer;
+  cmark_strbuf html;
+  cmark_mem *mem;
+  int options;
+} html_sink;
+
+static int S_sink_render_node(cmark_render_sink *sink, cmark_node *node,
+                              cmark_event_type ev_type) {
+  html_sink *hs = (html_sink *)sink;
+  S_render_node(&hs->renderer, node, ev_type, hs->options);
+  return 1;
+}
+
+static char *S_sink_finish(cmark_render_sink *sink) {
+  html_sink *hs = (html_sink *)sink;
+  cmark_mem *mem = hs->mem;
   char *result;
-  cmark_strbuf html = CMARK_BUF_INIT(mem);
-  cmark_event_type ev_type;
-  cmark_node *cur;
-  cmark_html_renderer renderer = {&html, NULL, NULL, 0, 0, NULL};
-  cmark_iter *iter = cmark_iter_new(root);
+
+  if (hs->renderer.footnote_ix) {
+    cmark_strbuf_puts(&hs->html, "</ol>\n</section>\n");
+  }
+
+  result = (char *)cmark_strbuf_detach(&hs->html);
+
+  cmark_llist_free(mem, hs->renderer.filter_extensions);
+  mem->free(hs);
+
+  return result;
+}
+
+// Whether the raw HTML of 'root' was classified against all of
+// 'filter_extensions' when it was parsed.
+static bool S_filters_classified(cmark_node *root,
+                                 cmark_llist *filter_extensions) {
+  cmark_llist *it, *doc_it;
+
+  if (!root || root->type != CMARK_NODE_DOCUMENT || !filter_extensions)
+    return false;
+
+  for (it = filter_extensions; it; it = it->next) {
+    for (doc_it = root->as.document.html_filters; doc_it; doc_it = doc_it->next)
+      if (doc_it->data == it->data)
+        break;
+    if (!doc_it)
+      return false;
+  }
+
+  return true;
+}
+
+cmark_llist *cmark_html_filter_extensions(cmark_mem *mem,
+                                          cmark_llist *extensions) {
+  cmark_llist *filter_extensions = NULL;
 
   for (; extensions; extensions = extensions->next)
     if (((cmark_syntax_extension *) extensions->data)->html_filter_func)
-      renderer.filter_extensions = cmark_llist_append(
+      filter_extensions = cmark_llist_append(
           mem,
-          renderer.filter_extensions,
+          filter_extensions,
           (cmark_syntax_extension *) extensions->data);
 
-  while ((ev_type = cmark_iter_next(iter)) != CMARK_EVENT_DONE) {
-    cur = cmark_iter_get_node(iter);
-    S_render_node(&renderer, cur, ev_type, options);
-  }
+  return filter_extensions;
+}
 
-  if (renderer.footnote_ix) {
-    cmark_strbuf_puts(&html, "</ol>\n</section>\n");
-  }
+cmark_render_sink *cmark_html_sink_new(cmark_mem *mem, cmark_node *root,
+                                       int options, cmark_llist *extensions,
+                                       size_t capacity) {
+  html_sink *hs = (html_sink *)mem->calloc(1, sizeof(*hs));
+  cmark_html_renderer renderer = {&hs->html, NULL, NULL, 0, 0, NULL, false};
 
-  result = (char *)cmark_strbuf_detach(&html);
+  hs->sink.render_node = S_sink_render_node;
+  hs->sink.finish = S_sink_finish;
+  hs->mem = mem;
+  hs->options = options;
+  hs->renderer = renderer;
 
-  cmark_llist_free(mem, renderer.filter_extensions);
+  cmark_strbuf_init(mem, &hs->html,
+                    cmark_render_size_hint(root, capacity, HTML_BYTES_PER_NODE));
 
-  cmark_iter_free(iter);
-  return result;
+  hs->renderer.filter_extensions =
+      cmark_html_filter_extensions(mem, extensions);
+  hs->renderer.filters_classified =
+      S_filters_classified(root, hs->renderer.filter_extensions);
+
+  return &hs->sink;
+}
+
+void cmark_html_render_to(cmark_strbuf *html, cmark_node *root, int options,
+                          cmark_llist *filter_extensions) {
+  cmark_html_renderer renderer = {html, NULL, filter_extensions, 0, 0, NULL,
+                                  false};
+  cmark_event_type ev_type;
+  cmark_iter iter;
+
+  renderer.filters_classified = S_filters_classified(root, filter_extensions);
+
+  cmark_iter_init(&iter, root);
+  while ((ev_type = cmark_iter_next(&iter)) != CMARK_EVENT_DONE)
+    S_render_node(&renderer, cmark_iter_get_node(&iter), ev_type, options);
+
+  if (renderer.footnote_ix) {
+    cmark_strbuf_puts(html, "</ol>\n</section>\n");
+  }
+}
+
+char *cmark_render_html_with_mem_and_capacity(cmark_node *root, int options,
+                                              cmark_llist *extensions,
+                                              cmark_mem *mem, size_t capacity) {
+  return cmark_render_sink_run(
+      root, cmark_html_sink_new(mem, root, options, extensions, capacity));
 }
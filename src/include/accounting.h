@@ -0,0 +1,20 @@
+#ifndef CMARK_ACCOUNTING_H
+#define CMARK_ACCOUNTING_H
+
+#include "cmark-gfm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Returns a pointer to the 'over_budget' statistic of 'mem' if it is an
+ * accounting allocator with a budget, NULL otherwise.  Parsers created with 'mem' check
+ * it along with their cancel function.
+ */
+const int *cmark_accounting_mem_over_budget(cmark_mem *mem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
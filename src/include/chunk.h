@@ -17,8 +17,20 @@ typedef struct cmark_chunk {
   bufsize_t alloc; // also implies a NULL-terminated string
 } cmark_chunk;
 
+// 'alloc' of a chunk that holds one reference to a string shared with
+// other chunks.  The string is preceded by its reference count, and is
+// freed with the last chunk that refers to it.
+#define CMARK_CHUNK_SHARED ((bufsize_t)-1)
+
+static inline size_t *cmark_chunk_refcount(const cmark_chunk *c) {
+  return (size_t *)c->data - 1;
+}
+
 static inline void cmark_chunk_free(cmark_mem *mem, cmark_chunk *c) {
-  if (c->alloc)
+  if (c->alloc == CMARK_CHUNK_SHARED) {
+    if (--*cmark_chunk_refcount(c) == 0)
+      mem->free(cmark_chunk_refcount(c));
+  } else if (c->alloc)
     mem->free(c->data);
 
   c->data = NULL;
@@ -77,7 +89,7 @@ static inline const char *cmark_chunk_to_cstr(cmark_mem *mem, cmark_chunk *c) {
 
 static inline void cmark_chunk_set_cstr(cmark_mem *mem, cmark_chunk *c,
                                         const char *str) {
-  unsigned char *old = c->alloc ? c->data : NULL;
+  cmark_chunk old = *c;
   if (str == NULL) {
     c->len = 0;
     c->data = NULL;
@@ -88,9 +100,7 @@ static inline void cmark_chunk_set_cstr(cmark_mem *mem, cmark_chunk *c,
     c->alloc = 1;
     memcpy(c->data, str, c->len + 1);
   }
-  if (old != NULL) {
-    mem->free(old);
-  }
+  cmark_chunk_free(mem, &old);
 }
 
 static inline cmark_chunk cmark_chunk_literal(const char *data) {
@@ -115,6 +125,35 @@ static inline cmark_chunk cmark_chunk_buf_detach(cmark_strbuf *buf) {
   return c;
 }
 
+// Return a shared chunk with a copy of the 'len' bytes at 'data'.
+static inline cmark_chunk cmark_chunk_new_shared(cmark_mem *mem,
+                                                 const unsigned char *data,
+                                                 bufsize_t len) {
+  size_t *refcount = (size_t *)mem->calloc(sizeof(size_t) + len + 1, 1);
+  cmark_chunk c;
+
+  *refcount = 1;
+  c.data = (unsigned char *)(refcount + 1);
+  c.len = len;
+  c.alloc = CMARK_CHUNK_SHARED;
+  if (len)
+    memcpy(c.data, data, len);
+
+  return c;
+}
+
+// Return another reference to the string of a shared chunk.  Any other
+// chunk that owns its data is copied into a new shared chunk.
+static inline cmark_chunk cmark_chunk_share(cmark_mem *mem, cmark_chunk *c) {
+  if (c->alloc == CMARK_CHUNK_SHARED) {
+    ++*cmark_chunk_refcount(c);
+    return *c;
+  }
+  if (c->alloc)
+    return cmark_chunk_new_shared(mem, c->data, c->len);
+  return *c;
+}
+
 /* trim_new variants are to be used when the source chunk may or may not be
  * allocated; forces a newly allocated chunk. */
 static inline cmark_chunk cmark_chunk_ltrim_new(cmark_mem *mem, cmark_chunk *c) {
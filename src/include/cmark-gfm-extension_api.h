@@ -66,6 +66,10 @@ typedef struct cmark_plugin cmark_plugin;
  * new block with cmark_parser_make_block and cmark_parser_add_child.
  * If no function was provided is NULL, the extension will have
  * no effect at all on the final block structure of the AST.
+ * If the extension provided the characters its blocks can start with
+ * through 'cmark_syntax_extension_set_block_start_chars', the function
+ * is only called for lines whose first non-space character is one of
+ * them, or which are in a block created by the extension.
  *
  * #### Inline parsing phase hooks
  *
@@ -266,6 +270,26 @@ typedef void (*cmark_opaque_free_func) (cmark_syntax_extension *extension,
                                         cmark_mem *mem,
                                         cmark_node *node);
 
+/** Should write the opaque data of 'node' to 'buf', which has room for
+ * 'size' bytes, and return the number of bytes needed.  If that is more
+ * than 'size', the function is called again with a larger buffer.
+ */
+typedef size_t (*cmark_opaque_serialize_func) (cmark_syntax_extension *extension,
+                                               cmark_node *node,
+                                               unsigned char *buf,
+                                               size_t size);
+
+/** Should restore the opaque data of 'node', already set up by the
+ * extension's opaque alloc function, from the 'len' bytes at 'data'
+ * written by its serialize function, which may be 0.  Should return 0 if
+ * the data is invalid, 1 otherwise.
+ */
+typedef int (*cmark_opaque_deserialize_func) (cmark_syntax_extension *extension,
+                                              cmark_mem *mem,
+                                              cmark_node *node,
+                                              const unsigned char *data,
+                                              size_t len);
+
 /** Free a cmark_syntax_extension.
  */
 CMARK_GFM_EXPORT
@@ -306,12 +330,20 @@ CMARK_GFM_EXPORT
 void cmark_syntax_extension_set_inline_from_delim_func(cmark_syntax_extension *extension,
                                                        cmark_inline_from_delim_func func);
 
-/** See the documentation for 'cmark_syntax_extension'
+/** See the documentation for 'cmark_syntax_extension'. Must be called
+ * before the extension is attached to a parser.
  */
 CMARK_GFM_EXPORT
 void cmark_syntax_extension_set_special_inline_chars(cmark_syntax_extension *extension,
                                                      cmark_llist *special_chars);
 
+/** See the documentation for 'cmark_syntax_extension'. Must be called
+ * before the extension is attached to a parser.
+ */
+CMARK_GFM_EXPORT
+void cmark_syntax_extension_set_block_start_chars(cmark_syntax_extension *extension,
+                                                  cmark_llist *start_chars);
+
 /** See the documentation for 'cmark_syntax_extension'
  */
 CMARK_GFM_EXPORT
@@ -408,6 +440,18 @@ CMARK_GFM_EXPORT
 void cmark_syntax_extension_set_opaque_free_func(cmark_syntax_extension *extension,
                                                  cmark_opaque_free_func func);
 
+/** See the documentation for 'cmark_syntax_extension'
+ */
+CMARK_GFM_EXPORT
+void cmark_syntax_extension_set_opaque_serialize_func(cmark_syntax_extension *extension,
+                                                      cmark_opaque_serialize_func func);
+
+/** See the documentation for 'cmark_syntax_extension'
+ */
+CMARK_GFM_EXPORT
+void cmark_syntax_extension_set_opaque_deserialize_func(cmark_syntax_extension *extension,
+                                                        cmark_opaque_deserialize_func func);
+
 /** See the documentation for 'cmark_syntax_extension'
  */
 CMARK_GFM_EXPORT
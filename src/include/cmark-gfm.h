@@ -28,6 +28,19 @@ extern "C" {
 CMARK_GFM_EXPORT
 char *cmark_markdown_to_html(const char *text, size_t len, int options);
 
+/** Convert each of the 'n' strings in 'texts', with lengths in 'lens', to
+ * HTML as 'cmark_markdown_to_html' does with CMARK_OPT_INLINE_ONLY added
+ * to 'options', reusing one parser for all of them; see
+ * 'cmark_parser_render_html_batch'.  The results are stored one after the
+ * other in the returned buffer, each null-terminated, at the offsets
+ * stored in 'offsets', which must have room for 'n' of them.  It is the
+ * caller's responsibility to free the returned buffer.
+ */
+CMARK_GFM_EXPORT
+char *cmark_markdown_to_html_batch(const char *const *texts,
+                                   const size_t *lens, size_t n, int options,
+                                   size_t *offsets);
+
 /** ## Node Structure
  */
 
@@ -126,6 +139,53 @@ cmark_mem *cmark_get_arena_mem_allocator(void);
 CMARK_GFM_EXPORT
 void cmark_arena_reset(void);
 
+/** Memory used through an accounting allocator, see
+ * 'cmark_accounting_mem_new'.
+ */
+typedef struct cmark_mem_stats {
+  /** Bytes allocated and not freed yet. */
+  size_t current_bytes;
+  /** Highest value of 'current_bytes' since the allocator was created or
+   * its statistics were reset. */
+  size_t peak_bytes;
+  /** Number of allocations and reallocations since then. */
+  size_t allocations;
+  /** The budget the allocator was created with, 0 for none. */
+  size_t budget;
+  /** 1 once 'current_bytes' has exceeded the budget. */
+  int over_budget;
+} cmark_mem_stats;
+
+/** Creates an allocator that uses the system's calloc, realloc and free,
+ * counting the memory allocated through it.  If 'budget' is not 0, a
+ * parser using the allocator stops as if cancelled (see
+ * 'cmark_parser_set_cancel_func') soon after more than 'budget' bytes
+ * are in use, and 'cmark_parser_finish' returns NULL.  The allocator is
+ * not thread-safe, and at most 64 can exist at a time: returns NULL if
+ * there are that many already.
+ */
+CMARK_GFM_EXPORT
+cmark_mem *cmark_accounting_mem_new(size_t budget);
+
+/** Frees an allocator created with 'cmark_accounting_mem_new'.  All memory
+ * allocated through it must have been freed.
+ */
+CMARK_GFM_EXPORT
+void cmark_accounting_mem_free(cmark_mem *mem);
+
+/** Copies the statistics of accounting allocator 'mem' to 'stats'.
+ * Returns 0 if 'mem' is not an accounting allocator, 1 otherwise.
+ */
+CMARK_GFM_EXPORT
+int cmark_accounting_mem_get_stats(cmark_mem *mem, cmark_mem_stats *stats);
+
+/** Restarts the peak and the count of allocations of accounting allocator
+ * 'mem' from the memory currently in use, for instance to measure a
+ * rendering separately from the parse before it.
+ */
+CMARK_GFM_EXPORT
+void cmark_accounting_mem_reset_stats(cmark_mem *mem);
+
 /** Callback for freeing user data with a 'cmark_mem' context.
  */
 typedef void (*cmark_free_func) (cmark_mem *mem, void *user_data);
@@ -235,6 +295,12 @@ CMARK_GFM_EXPORT cmark_node *cmark_node_nth_child(cmark_node *node, int n);
  */
 CMARK_GFM_EXPORT cmark_node *cmark_node_parent_footnote_def(cmark_node *node);
 
+/** Returns the number of the footnote 'node' defines or refers to, or 0 if
+ * 'node' is not a resolved footnote definition or reference.  The literal
+ * of a footnote reference is its label.
+ */
+CMARK_GFM_EXPORT int cmark_node_get_footnote_ix(cmark_node *node);
+
 /**
  * ## Iterator
  *
@@ -610,11 +676,60 @@ void cmark_parser_free(cmark_parser *parser);
 CMARK_GFM_EXPORT
 void cmark_parser_feed(cmark_parser *parser, const char *buffer, size_t len);
 
-/** Finish parsing and return a pointer to a tree of nodes.
+/** Finish parsing and return a pointer to a tree of nodes.  Returns NULL
+ * if the parse was cancelled, see 'cmark_parser_set_cancel_func'.
  */
 CMARK_GFM_EXPORT
 cmark_node *cmark_parser_finish(cmark_parser *parser);
 
+/** Parse each of the 'n' strings in 'texts', with lengths in 'lens', as a
+ * document of its own with 'parser', and render it as HTML with the
+ * parser's options and syntax extensions.  This is meant for many short
+ * strings, such as titles or labels parsed with CMARK_OPT_INLINE_ONLY,
+ * and saves most of the allocations of parsing and rendering them one by
+ * one.  The results are stored as for 'cmark_markdown_to_html_batch',
+ * with an empty string for a parse that was cancelled, in a buffer
+ * allocated with the parser's allocator.  Input already fed to 'parser'
+ * is parsed along with the first string.
+ */
+CMARK_GFM_EXPORT
+char *cmark_parser_render_html_batch(cmark_parser *parser,
+                                     const char *const *texts,
+                                     const size_t *lens, size_t n,
+                                     size_t *offsets);
+
+/** Called with the 'data' it was set with while a parser is working.
+ * Returns non-zero to cancel the parse.
+ */
+typedef int (*cmark_parser_cancel_func)(void *data);
+
+/** Sets a function to be called every few hundred lines while 'parser'
+ * processes input in 'cmark_parser_feed' and every few hundred inlines
+ * while it parses inline content in 'cmark_parser_finish', to bound the
+ * time spent on a document:
+ *
+ *     static int past_deadline(void *data) {
+ *       return clock() > *(clock_t *)data;
+ *     }
+ *
+ *     clock_t deadline = clock() + CLOCKS_PER_SEC / 10;
+ *     cmark_parser_set_cancel_func(parser, past_deadline, &deadline);
+ *
+ * Once 'func' returns non-zero, the rest of the input is ignored and
+ * 'cmark_parser_finish' frees the partial document and returns NULL.
+ * The parser can then be used for another document.  The function is kept
+ * until set again; a NULL 'func' removes it.
+ */
+CMARK_GFM_EXPORT
+void cmark_parser_set_cancel_func(cmark_parser *parser,
+                                  cmark_parser_cancel_func func, void *data);
+
+/** Returns 1 if the document being parsed by 'parser' was cancelled by
+ * its cancel function, 0 otherwise.
+ */
+CMARK_GFM_EXPORT
+int cmark_parser_is_cancelled(cmark_parser *parser);
+
 /** Parse a CommonMark document in 'buffer' of length 'len'.
  * Returns a pointer to a tree of nodes.  The memory allocated for
  * the node tree should be released using 'cmark_node_free'
@@ -646,6 +761,14 @@ char *cmark_render_xml(cmark_node *root, int options);
 CMARK_GFM_EXPORT
 char *cmark_render_xml_with_mem(cmark_node *root, int options, cmark_mem *mem);
 
+/** As for 'cmark_render_xml_with_mem', but reserving 'capacity' bytes for
+ * the resulting string up front.  If 'capacity' is 0, the size is estimated
+ * from the document the tree was parsed from.
+ */
+CMARK_GFM_EXPORT
+char *cmark_render_xml_with_mem_and_capacity(cmark_node *root, int options,
+                                             cmark_mem *mem, size_t capacity);
+
 /** Render a 'node' tree as an HTML fragment.  It is up to the user
  * to add an appropriate header and footer. It is the caller's
  * responsibility to free the returned buffer.
@@ -659,6 +782,15 @@ char *cmark_render_html(cmark_node *root, int options, cmark_llist *extensions);
 CMARK_GFM_EXPORT
 char *cmark_render_html_with_mem(cmark_node *root, int options, cmark_llist *extensions, cmark_mem *mem);
 
+/** As for 'cmark_render_html_with_mem', but reserving 'capacity' bytes for
+ * the resulting string up front.  If 'capacity' is 0, the size is estimated
+ * from the document the tree was parsed from.
+ */
+CMARK_GFM_EXPORT
+char *cmark_render_html_with_mem_and_capacity(cmark_node *root, int options,
+                                              cmark_llist *extensions,
+                                              cmark_mem *mem, size_t capacity);
+
 /** Render a 'node' tree as a groff man page, without the header.
  * It is the caller's responsibility to free the returned buffer.
  */
@@ -683,6 +815,16 @@ char *cmark_render_commonmark(cmark_node *root, int options, int width);
 CMARK_GFM_EXPORT
 char *cmark_render_commonmark_with_mem(cmark_node *root, int options, int width, cmark_mem *mem);
 
+/** As for 'cmark_render_commonmark_with_mem', but reserving 'capacity' bytes
+ * for the resulting string up front.  If 'capacity' is 0, the size is
+ * estimated from the document the tree was parsed from.
+ */
+CMARK_GFM_EXPORT
+char *cmark_render_commonmark_with_mem_and_capacity(cmark_node *root,
+                                                    int options, int width,
+                                                    cmark_mem *mem,
+                                                    size_t capacity);
+
 /** Render a 'node' tree as a plain text document.
  * It is the caller's responsibility to free the returned buffer.
  */
@@ -707,6 +849,82 @@ char *cmark_render_latex(cmark_node *root, int options, int width);
 CMARK_GFM_EXPORT
 char *cmark_render_latex_with_mem(cmark_node *root, int options, int width, cmark_mem *mem);
 
+/** Output formats for 'cmark_render_multi'.
+ */
+typedef enum {
+  CMARK_FORMAT_HTML,
+  CMARK_FORMAT_XML,
+  CMARK_FORMAT_MAN,
+  CMARK_FORMAT_COMMONMARK,
+  CMARK_FORMAT_PLAINTEXT,
+  CMARK_FORMAT_LATEX
+} cmark_format;
+
+/** An output requested from 'cmark_render_multi'.
+ */
+typedef struct {
+  /** Format to render. */
+  cmark_format format;
+  /** Rendering options, as for the 'cmark_render_*' functions. */
+  int options;
+  /** Line width for man, CommonMark, plaintext and LaTeX output. */
+  int width;
+  /** Extensions for HTML output, as for 'cmark_render_html'. */
+  cmark_llist *extensions;
+  /** The rendered output, set by 'cmark_render_multi'.  It is the caller's
+   * responsibility to free it. */
+  char *result;
+} cmark_render_target;
+
+/** Render a 'node' tree to each of the 'n_targets' formats in 'targets'
+ * in a single traversal, storing the outputs in their 'result' fields.
+ * Each output is the same as the matching 'cmark_render_*' function
+ * produces.  Returns 0, without rendering anything, if a target has an
+ * unknown format.
+ */
+CMARK_GFM_EXPORT
+int cmark_render_multi(cmark_node *root, cmark_render_target *targets,
+                       size_t n_targets);
+
+/** As for 'cmark_render_multi', but specifying the allocator to use for
+ * the resulting strings.
+ */
+CMARK_GFM_EXPORT
+int cmark_render_multi_with_mem(cmark_node *root, cmark_render_target *targets,
+                                size_t n_targets, cmark_mem *mem);
+
+/**
+ * ## Serialization
+ */
+
+/** Serialize a 'node' tree into a compact binary form that
+ * 'cmark_deserialize' turns back into an equivalent tree much faster than
+ * parsing the source again, so parsed documents can be cached.  The size
+ * of the result is stored in 'len'.  It is the caller's responsibility to
+ * free the returned buffer.
+ *
+ * The format is only meant to be read back by the same version of the
+ * library, with the same syntax extensions registered.
+ */
+CMARK_GFM_EXPORT
+char *cmark_serialize(cmark_node *root, size_t *len);
+
+/** Rebuild a tree from 'len' bytes of 'data' written by 'cmark_serialize'.
+ * Nodes belonging to a syntax extension are looked up with
+ * 'cmark_find_syntax_extension'.  Returns NULL if the data is invalid or
+ * truncated.  The tree should be released using 'cmark_node_free' when it
+ * is no longer needed.
+ */
+CMARK_GFM_EXPORT
+cmark_node *cmark_deserialize(const char *data, size_t len);
+
+/** As for 'cmark_deserialize', but specifying the allocator to use for the
+ * resulting tree.
+ */
+CMARK_GFM_EXPORT
+cmark_node *cmark_deserialize_with_mem(const char *data, size_t len,
+                                       cmark_mem *mem);
+
 /**
  * ## Options
  */
@@ -811,6 +1029,18 @@ char *cmark_render_latex_with_mem(cmark_node *root, int options, int width, cmar
  */
 #define CMARK_OPT_TABLE_ROWSPAN_DITTO (1 << 21)
 
+/** Defer parsing the inline content of each block until its children are
+ * first accessed, through `cmark_node_first_child`, an iterator or a
+ * renderer.  The resulting tree is the same as with an eager parse, but
+ * callers that only look at block structure (headings, the first
+ * paragraph, ...) don't pay for inline parsing of the rest.  Since reading
+ * a node may then modify the tree, a document parsed with this option must
+ * not be accessed from several threads at once.  Ignored when
+ * \c CMARK_OPT_FOOTNOTES is set, since footnotes are numbered in document
+ * order.
+ */
+#define CMARK_OPT_LAZY_INLINES (1 << 22)
+
 /**
  * ## Version information
  */
@@ -23,5 +23,20 @@ static void cmark_html_render_sourcepos(cmark_node *node, cmark_strbuf *html, in
   }
 }
 
+/* Set CMARK_NODE__HTML_UNFILTERED on an HTML_BLOCK or HTML_INLINE 'node'
+ * if none of 'filter_extensions' rejects any of its tags, as checked by the
+ * HTML renderer.  Called by the parser as raw HTML is recognized, so that
+ * rendering doesn't need to run the filters again. */
+void cmark_html_classify(cmark_llist *filter_extensions, cmark_node *node);
+
+/* Return a list of those of 'extensions' that filter raw HTML, for
+ * cmark_html_render_to.  The caller frees it with cmark_llist_free. */
+cmark_llist *cmark_html_filter_extensions(cmark_mem *mem,
+                                          cmark_llist *extensions);
+
+/* Render 'root' as HTML at the end of 'html', as cmark_render_html does
+ * with the extensions that 'filter_extensions' was made from. */
+void cmark_html_render_to(cmark_strbuf *html, cmark_node *root, int options,
+                          cmark_llist *filter_extensions);
 
 #endif
@@ -0,0 +1,46 @@
+#ifndef CMARK_INTERNER_H
+#define CMARK_INTERNER_H
+
+#include "chunk.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct cmark_interner_entry {
+  unsigned char *data;
+  bufsize_t len;
+  uint32_t hash;
+};
+
+/* A hash set of the shared strings of a document, so that strings that
+ * recur in it, like the destinations of links and the info strings of code
+ * blocks, are stored once.  It holds a reference to each of its strings,
+ * which outlive it in the nodes that refer to them. */
+struct cmark_interner {
+  cmark_mem *mem;
+  struct cmark_interner_entry *entries;
+  size_t size;
+  size_t capacity;
+};
+
+typedef struct cmark_interner cmark_interner;
+
+void cmark_interner_init(cmark_interner *interner, cmark_mem *mem);
+
+/* Drop the interner's references to its strings, keeping its table. */
+void cmark_interner_clear(cmark_interner *interner);
+
+void cmark_interner_free(cmark_interner *interner);
+
+/* Return a shared chunk with the 'len' bytes at 'data', stored once for
+ * all the chunks the interner returns with the same bytes.  Empty strings
+ * are returned as an empty chunk. */
+cmark_chunk cmark_interner_intern(cmark_interner *interner,
+                                  const unsigned char *data, bufsize_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
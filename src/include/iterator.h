@@ -5,7 +5,10 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
+
 #include "cmark-gfm.h"
+#include "buffer.h"
 
 typedef struct {
   cmark_event_type ev_type;
@@ -19,6 +22,20 @@ struct cmark_iter {
   cmark_iter_state next;
 };
 
+/* Initialize a caller-owned iterator over 'root', which then needs no
+ * 'cmark_iter_free'.  Used internally instead of 'cmark_iter_new' to avoid
+ * allocating an iterator for every traversal. */
+CMARK_GFM_EXPORT
+void cmark_iter_init(cmark_iter *iter, cmark_node *root);
+
+/* Merge the text nodes following the text node 'iter' is on into it,
+ * moving 'iter' past them.  'buf' is scratch space. */
+void cmark_iter_merge_text(cmark_iter *iter, cmark_strbuf *buf);
+
+/* Whether the iterator returns only an enter event for 'node', and no exit
+ * event. */
+bool cmark_iter_is_leaf(cmark_node *node);
+
 #ifdef __cplusplus
 }
 #endif
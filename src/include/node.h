@@ -53,14 +53,35 @@ typedef struct {
   cmark_chunk on_exit;
 } cmark_custom;
 
+typedef struct {
+  // Size in bytes of the source the document was parsed from.
+  size_t source_size;
+  // Approximate number of nodes in the document, used together with
+  // 'source_size' to estimate the size of rendered output.
+  size_t node_count;
+  // With CMARK_OPT_LAZY_INLINES, the parser holding the reference map and
+  // extensions used to parse the inlines of blocks on first access.
+  cmark_parser *inline_parser;
+  // The extensions with an html_filter_func the document was parsed with,
+  // which its raw HTML nodes were classified against, see
+  // CMARK_NODE__HTML_UNFILTERED.
+  cmark_llist *html_filters;
+} cmark_document;
+
 enum cmark_node__internal_flags {
   CMARK_NODE__OPEN = (1 << 0),
   CMARK_NODE__LAST_LINE_BLANK = (1 << 1),
   CMARK_NODE__LAST_LINE_CHECKED = (1 << 2),
+  // The inline content of the block has not been parsed yet, see
+  // CMARK_OPT_LAZY_INLINES.
+  CMARK_NODE__INLINES_PENDING = (1 << 3),
+  // None of the tags of the raw HTML is rejected by the document's
+  // html_filters, so the HTML renderer can output it as is.
+  CMARK_NODE__HTML_UNFILTERED = (1 << 4),
 
   // Extensions can register custom flags by calling `cmark_register_node_flag`.
   // This is the starting value for the custom flags.
-  CMARK_NODE__REGISTER_FIRST = (1 << 3),
+  CMARK_NODE__REGISTER_FIRST = (1 << 5),
 };
 
 typedef uint16_t cmark_node_internal_flags;
@@ -101,6 +122,10 @@ struct cmark_node {
     int def_count;
   } footnote;
 
+  // The number of a footnote once references are resolved, on both the
+  // definition and its references.  0 if unresolved.
+  int footnote_ix;
+
   cmark_node *parent_footnote_def;
 
   union {
@@ -111,6 +136,7 @@ struct cmark_node {
     cmark_link link;
     cmark_attribute attribute;
     cmark_custom custom;
+    cmark_document document;
     int html_block_type;
     void *opaque;
   } as;
@@ -166,6 +192,17 @@ CMARK_GFM_EXPORT bool cmark_node_can_contain_type(cmark_node *node, cmark_node_t
  */
 CMARK_GFM_EXPORT void cmark_enable_safety_checks(bool enable);
 
+/**
+ * Parse the inline content of a block deferred by CMARK_OPT_LAZY_INLINES.
+ * Called whenever the children of such a block are about to be accessed.
+ */
+void cmark_node_parse_pending_inlines(cmark_node *node);
+
+static inline void cmark_node_ensure_inlines(cmark_node *node) {
+  if (node->flags & CMARK_NODE__INLINES_PENDING)
+    cmark_node_parse_pending_inlines(node);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -6,6 +6,7 @@
 #include <stdlib.h>
 
 #include "references.h"
+#include "interner.h"
 #include "node.h"
 #include "buffer.h"
 
@@ -19,6 +20,9 @@ struct cmark_parser {
   struct cmark_mem *mem;
   /* A hashtable of urls in the current document for cross-references */
   struct cmark_map *refmap;
+  /* The link destinations and titles and the info strings of code blocks
+   * in the current document, each stored once */
+  cmark_interner interner;
   /* The root node of the parser, always a CMARK_NODE_DOCUMENT */
   struct cmark_node *root;
   /* The last open block after a line is fully processed */
@@ -46,18 +50,74 @@ struct cmark_parser {
   bufsize_t last_line_length;
   /* FIXME: not sure about the difference with curline */
   cmark_strbuf linebuf;
+  /* Buffer that the lines of the next leaf block are collected in; it is
+   * handed back once the block is finalized, see add_line() in blocks.c */
+  cmark_strbuf content;
+  /* The open blocks from the root down, each the last child of the one
+   * before, as they are when a line starts, see S_update_open_blocks() in
+   * blocks.c */
+  struct cmark_node **open_blocks;
+  bufsize_t num_open_blocks;
+  bufsize_t open_blocks_size;
+  /* No open block less deep than this has CMARK_NODE__LAST_LINE_BLANK set */
+  bufsize_t blank_depth;
   /* Options set by the user, see the Options section in cmark.h */
   int options;
   bool last_buffer_ended_with_cr;
   size_t total_size;
+  /* Number of nodes created so far, recorded on the document root */
+  size_t node_count;
   cmark_llist *syntax_extensions;
   cmark_llist *inline_syntax_extensions;
+  /* The syntax extensions with an html_filter_func, which raw HTML is
+   * classified against as it is parsed */
+  cmark_llist *html_filter_extensions;
   cmark_ispunct_func backslash_ispunct;
   /* used when parsing inlines, can be populated by extensions if any are loaded */
   int8_t *skip_chars;
   int8_t *special_chars;
+  /* The block starts a line can begin with, by its first non-space byte;
+   * a table of its own once an extension that opens blocks is attached */
+  uint16_t *block_starts;
+  /* The syntax extensions with a try_opening_block function, in the order
+   * they were attached, followed by NULL */
+  struct cmark_syntax_extension **block_extensions;
+  /* The inline syntax extensions by the special characters they were
+   * attached with, in the order they were attached: those for 'c' are
+   * inline_extensions[inline_extension_index[c]] up to, but not including,
+   * inline_extensions[inline_extension_index[c + 1]].  NULL if there are
+   * none. */
+  uint16_t *inline_extension_index;
+  struct cmark_syntax_extension **inline_extensions;
+  /* See the documentation for cmark_parser_set_cancel_func() in cmark.h */
+  cmark_parser_cancel_func cancel_func;
+  void *cancel_data;
+  /* Set if the parser allocates with an accounting allocator with a
+   * budget, see cmark_accounting_mem_over_budget() */
+  const int *over_budget;
+  /* Lines and inlines left before cancel_func is called again */
+  int cancel_countdown;
+  bool cancelled;
 };
 
+/* How many lines or inlines are parsed between two calls to the
+ * cancel_func of a parser */
+#define CMARK_CANCEL_INTERVAL 256
+
+/* Returns true if the parse has been cancelled, calling the cancel_func of
+ * 'parser' and checking its memory budget once every CMARK_CANCEL_INTERVAL
+ * calls */
+static inline bool cmark_parser_check_cancel(cmark_parser *parser) {
+  if ((parser->cancel_func || parser->over_budget) && !parser->cancelled &&
+      --parser->cancel_countdown <= 0) {
+    parser->cancel_countdown = CMARK_CANCEL_INTERVAL;
+    parser->cancelled =
+        (parser->over_budget && *parser->over_budget) ||
+        (parser->cancel_func && parser->cancel_func(parser->cancel_data));
+  }
+  return parser->cancelled;
+}
+
 #ifdef __cplusplus
 }
 #endif
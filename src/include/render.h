@@ -41,6 +41,9 @@ struct cmark_html_renderer {
   unsigned int footnote_ix;
   unsigned int written_footnote_ix;
   void *opaque;
+  /* The document's raw HTML was classified against the filter extensions
+   * when parsed, see CMARK_NODE__HTML_UNFILTERED. */
+  bool filters_classified;
 };
 
 typedef struct cmark_html_renderer cmark_html_renderer;
@@ -57,6 +60,63 @@ char *cmark_render(cmark_mem *mem, cmark_node *root, int options, int width,
                                       cmark_node *node,
                                       cmark_event_type ev_type, int options));
 
+/** One output of a tree traversal that can be shared by several
+ * renderers, see 'cmark_render_sinks'.
+ */
+typedef struct cmark_render_sink cmark_render_sink;
+
+struct cmark_render_sink {
+  /* Render one iterator event.  Returns 0 to skip the node's contents. */
+  int (*render_node)(cmark_render_sink *sink, cmark_node *node,
+                     cmark_event_type ev_type);
+  /* Return the rendered output and free the sink. */
+  char *(*finish)(cmark_render_sink *sink);
+  /* Node whose contents are being skipped, if any. */
+  cmark_node *skip;
+};
+
+/** Create a sink for the output formats built on 'cmark_renderer'.
+ * 'capacity' is the number of bytes to reserve for the output, or 0.
+ */
+cmark_render_sink *cmark_render_sink_new(
+    cmark_mem *mem, int options, int width, bufsize_t capacity,
+    void (*outc)(cmark_renderer *, cmark_node *, cmark_escaping, int32_t,
+                 unsigned char),
+    int (*render_node)(cmark_renderer *renderer, cmark_node *node,
+                       cmark_event_type ev_type, int options));
+
+cmark_render_sink *cmark_html_sink_new(cmark_mem *mem, cmark_node *root,
+                                       int options, cmark_llist *extensions,
+                                       size_t capacity);
+cmark_render_sink *cmark_xml_sink_new(cmark_mem *mem, cmark_node *root,
+                                      int options, size_t capacity);
+cmark_render_sink *cmark_commonmark_sink_new(cmark_mem *mem, cmark_node *root,
+                                             int options, int width,
+                                             size_t capacity);
+cmark_render_sink *cmark_man_sink_new(cmark_mem *mem, int options, int width);
+cmark_render_sink *cmark_latex_sink_new(cmark_mem *mem, int options,
+                                        int width);
+cmark_render_sink *cmark_plaintext_sink_new(cmark_mem *mem, int options,
+                                            int width);
+
+/** Feed every event of a traversal of 'root' to each of 'sinks', visiting
+ * each node once for all of them.
+ */
+void cmark_render_sinks(cmark_node *root, cmark_render_sink **sinks,
+                        size_t n_sinks);
+
+/** Render 'root' with the single 'sink' and return its output.
+ */
+char *cmark_render_sink_run(cmark_node *root, cmark_render_sink *sink);
+
+/** Return the number of bytes to reserve for the output of rendering
+ * 'root'.  A non-zero 'capacity' is used as given; otherwise the size is
+ * estimated from the source size and node count recorded on a parsed
+ * document, assuming 'bytes_per_node' bytes of markup per node.
+ */
+bufsize_t cmark_render_size_hint(cmark_node *root, size_t capacity,
+                                 size_t bytes_per_node);
+
 #ifdef __cplusplus
 }
 #endif
@@ -12,6 +12,8 @@ struct cmark_syntax_extension {
   cmark_match_inline_func         match_inline;
   cmark_inline_from_delim_func    insert_inline_from_delim;
   cmark_llist                   * special_inline_chars;
+  cmark_llist                   * block_start_chars;
+  bool                            block_start_table[256];
   char                          * name;
   void                          * priv;
   bool                            emphasis;
@@ -29,6 +31,8 @@ struct cmark_syntax_extension {
   cmark_postprocess_func          postprocess_func;
   cmark_opaque_alloc_func         opaque_alloc_func;
   cmark_opaque_free_func          opaque_free_func;
+  cmark_opaque_serialize_func     opaque_serialize_func;
+  cmark_opaque_deserialize_func   opaque_deserialize_func;
   cmark_commonmark_escape_func    commonmark_escape_func;
 };
 
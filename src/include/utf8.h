@@ -1,6 +1,7 @@
 #ifndef CMARK_UTF8_H
 #define CMARK_UTF8_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include "buffer.h"
 
@@ -8,10 +9,22 @@
 extern "C" {
 #endif
 
+/** The most bytes a single character can case fold to. */
+#define CMARK_CASE_FOLD_MAX_LENGTH 6
+
 CMARK_GFM_EXPORT
 void cmark_utf8proc_case_fold(cmark_strbuf *dest, const uint8_t *str,
                               bufsize_t len);
 
+/**
+ * Case fold the character at the start of the `len` bytes at `str` into
+ * `dest`, which has room for CMARK_CASE_FOLD_MAX_LENGTH bytes, and store
+ * the number of bytes written in `*dest_len`.  Returns the number of bytes
+ * of `str` consumed; an invalid byte is folded to U+FFFD.
+ */
+bufsize_t cmark_utf8proc_case_fold_char(const uint8_t *str, bufsize_t len,
+                                        uint8_t *dest, bufsize_t *dest_len);
+
 CMARK_GFM_EXPORT
 void cmark_utf8proc_encode_char(int32_t uc, cmark_strbuf *buf);
 
@@ -22,6 +35,14 @@ CMARK_GFM_EXPORT
 void cmark_utf8proc_check(cmark_strbuf *dest, const uint8_t *line,
                           bufsize_t size);
 
+/**
+ * Whether all of `str` is valid UTF-8 according to RFC 3629.  NUL bytes
+ * are accepted here, unlike in cmark_utf8proc_check.  Uses vector
+ * instructions where available.
+ */
+CMARK_GFM_EXPORT
+bool cmark_utf8proc_is_valid(const uint8_t *str, size_t len);
+
 CMARK_GFM_EXPORT
 int cmark_utf8proc_is_space(int32_t uc);
 
@@ -13,6 +13,7 @@
 #include "scanners.h"
 #include "inlines.h"
 #include "syntax_extension.h"
+#include "html.h"
 
 static const char *EMDASH = "\xE2\x80\x94";
 static const char *ENDASH = "\xE2\x80\x93";
@@ -68,6 +69,10 @@ typedef struct subject{
   bufsize_t backticks[MAXBACKTICKS + 1];
   bool scanned_for_backticks;
   bool no_link_openers;
+  // Offsets of the newlines in 'input', indexed on first use by
+  // count_newlines; -1 until then.
+  bufsize_t *newlines;
+  bufsize_t num_newlines;
 } subject;
 
 void cmark_set_default_skip_chars(int8_t **skip_chars, bool use_memcpy) {
@@ -211,6 +216,8 @@ static void subject_from_buf(cmark_mem *mem, int line_number, int block_offset,
   }
   e->scanned_for_backticks = false;
   e->no_link_openers = true;
+  e->newlines = NULL;
+  e->num_newlines = -1;
 }
 
 static inline int isbacktick(int c) { return (c == '`'); }
@@ -274,27 +281,53 @@ static inline cmark_chunk take_while(subject *subj, int (*f)(int)) {
   return cmark_chunk_dup(&subj->input, startpos, len);
 }
 
+static void index_newlines(subject *subj) {
+  const unsigned char *data = subj->input.data;
+  const unsigned char *p = data, *end = data + subj->input.len, *nl;
+  bufsize_t size = 0;
+
+  subj->num_newlines = 0;
+  while (p < end && (nl = (const unsigned char *)memchr(p, '\n', end - p))) {
+    if (subj->num_newlines == size) {
+      size = size ? size * 2 : 16;
+      subj->newlines = (bufsize_t *)subj->mem->realloc(
+          subj->newlines, size * sizeof(*subj->newlines));
+    }
+    subj->newlines[subj->num_newlines++] = (bufsize_t)(nl - data);
+    p = nl + 1;
+  }
+}
+
+// Return the index of the first newline at or after `pos`.
+static bufsize_t newline_index(subject *subj, bufsize_t pos) {
+  bufsize_t lo = 0, hi = subj->num_newlines;
+
+  while (lo < hi) {
+    bufsize_t mid = lo + (hi - lo) / 2;
+    if (subj->newlines[mid] < pos)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
 // Return the number of newlines in a given span of text in a subject.  If
 // the number is greater than zero, also return the number of characters
 // between the last newline and the end of the span in `since_newline`.
 static int count_newlines(subject *subj, bufsize_t from, bufsize_t len, int *since_newline) {
-  int nls = 0;
-  int since_nl = 0;
+  bufsize_t first, last;
 
-  while (len--) {
-    if (subj->input.data[from++] == '\n') {
-      ++nls;
-      since_nl = 0;
-    } else {
-      ++since_nl;
-    }
-  }
+  if (subj->num_newlines < 0)
+    index_newlines(subj);
 
-  if (!nls)
+  first = newline_index(subj, from);
+  last = newline_index(subj, from + len);
+  if (first == last)
     return 0;
 
-  *since_newline = since_nl;
-  return nls;
+  *since_newline = from + len - subj->newlines[last - 1] - 1;
+  return last - first;
 }
 
 // Adjust `node`'s `end_line`, `end_column`, and `subj`'s `line` and
@@ -662,19 +695,10 @@ static cmark_node *handle_period(subject *subj, bool smart) {
 }
 
 static cmark_syntax_extension *get_extension_for_special_char(cmark_parser *parser, unsigned char c) {
-  cmark_llist *tmp_ext;
+  uint16_t *index = parser->inline_extension_index;
 
-  for (tmp_ext = parser->inline_syntax_extensions; tmp_ext; tmp_ext=tmp_ext->next) {
-    cmark_syntax_extension *ext = (cmark_syntax_extension *) tmp_ext->data;
-    cmark_llist *tmp_char;
-    for (tmp_char = ext->special_inline_chars; tmp_char; tmp_char=tmp_char->next) {
-      unsigned char tmp_c = (unsigned char)(size_t)tmp_char->data;
-
-      if (tmp_c == c) {
-        return ext;
-      }
-    }
-  }
+  if (index && index[c] < index[c + 1])
+    return parser->inline_extensions[index[c]];
 
   return NULL;
 }
@@ -918,6 +942,46 @@ cmark_chunk cmark_clean_title(cmark_mem *mem, cmark_chunk *title) {
   return cmark_chunk_buf_detach(&buf);
 }
 
+// Return the bytes at 'data' with entities and backslash escapes resolved,
+// as cmark_clean_url and cmark_clean_title do, interned in the parser.
+static cmark_chunk S_intern_unescaped(cmark_parser *parser,
+                                      const unsigned char *data,
+                                      bufsize_t len) {
+  cmark_strbuf buf;
+  cmark_chunk result;
+
+  if (!memchr(data, '&', len) && !memchr(data, '\\', len))
+    return cmark_interner_intern(&parser->interner, data, len);
+
+  cmark_strbuf_init(parser->mem, &buf, 0);
+  houdini_unescape_html_f(&buf, data, len);
+  cmark_strbuf_unescape(&buf);
+  result = cmark_interner_intern(&parser->interner, buf.ptr, buf.size);
+  cmark_strbuf_free(&buf);
+  return result;
+}
+
+static cmark_chunk S_intern_url(cmark_parser *parser, cmark_chunk *url) {
+  cmark_chunk_trim(url);
+  return S_intern_unescaped(parser, url->data, url->len);
+}
+
+static cmark_chunk S_intern_title(cmark_parser *parser, cmark_chunk *title) {
+  unsigned char first, last;
+
+  if (title->len < 2)
+    return S_intern_unescaped(parser, title->data, title->len);
+
+  first = title->data[0];
+  last = title->data[title->len - 1];
+
+  // remove surrounding quotes if any:
+  if ((first == '\'' && last == '\'') || (first == '(' && last == ')') ||
+      (first == '"' && last == '"'))
+    return S_intern_unescaped(parser, title->data + 1, title->len - 2);
+  return S_intern_unescaped(parser, title->data, title->len);
+}
+
 // Clean custom attributes. This function uses `cmark_clean_url` internaly
 // because the requirements are the same
 cmark_chunk cmark_clean_attributes(cmark_mem *mem, cmark_chunk *attributes) {
@@ -1331,8 +1395,8 @@ static cmark_node *handle_close_bracket(cmark_parser *parser, subject *subj) {
 
       title_chunk =
           cmark_chunk_dup(&subj->input, starttitle, endtitle - starttitle);
-      url = cmark_clean_url(subj->mem, &url_chunk);
-      title = cmark_clean_title(subj->mem, &title_chunk);
+      url = S_intern_url(parser, &url_chunk);
+      title = S_intern_title(parser, &title_chunk);
       cmark_chunk_free(subj->mem, &url_chunk);
       cmark_chunk_free(subj->mem, &title_chunk);
       goto match;
@@ -1366,8 +1430,8 @@ static cmark_node *handle_close_bracket(cmark_parser *parser, subject *subj) {
   }
 
   if (ref != NULL && !ref->is_attributes_reference) { // found
-    url = chunk_clone(subj->mem, &ref->url);
-    title = chunk_clone(subj->mem, &ref->title);
+    url = cmark_chunk_share(subj->mem, &ref->url);
+    title = cmark_chunk_share(subj->mem, &ref->title);
     goto match;
   } else {
     goto noMatch;
@@ -1582,10 +1646,14 @@ static cmark_node *try_extensions(cmark_parser *parser,
                                   unsigned char c,
                                   subject *subj) {
   cmark_node *res = NULL;
-  cmark_llist *tmp;
+  uint16_t *index = parser->inline_extension_index;
+  uint16_t i;
+
+  if (!index)
+    return NULL;
 
-  for (tmp = parser->inline_syntax_extensions; tmp; tmp = tmp->next) {
-    cmark_syntax_extension *ext = (cmark_syntax_extension *) tmp->data;
+  for (i = index[c]; i < index[c + 1]; ++i) {
+    cmark_syntax_extension *ext = parser->inline_extensions[i];
     res = ext->match_inline(ext, parser, parent, c, subj);
 
     if (res)
@@ -1628,6 +1696,8 @@ static int parse_inline(cmark_parser *parser, subject *subj, cmark_node *parent,
     break;
   case '<':
     new_inl = handle_pointy_brace(subj, options);
+    if (new_inl->type == CMARK_NODE_HTML_INLINE)
+      cmark_html_classify(parser->html_filter_extensions, new_inl);
     break;
   case '*':
   case '_':
@@ -1712,8 +1782,9 @@ void cmark_parse_inlines(cmark_parser *parser,
   if ((options & CMARK_OPT_PRESERVE_WHITESPACE) == 0)
     cmark_chunk_rtrim(&subj.input);
 
-  while (!is_eof(&subj) && parse_inline(parser, &subj, parent, options))
-    ;
+  while (!is_eof(&subj) && !cmark_parser_check_cancel(parser) &&
+         parse_inline(parser, &subj, parent, options))
+    parser->node_count++;
 
   process_emphasis(parser, &subj, 0);
   // free bracket and delim stack
@@ -1723,6 +1794,8 @@ void cmark_parse_inlines(cmark_parser *parser,
   while (subj.last_bracket) {
     pop_bracket(&subj);
   }
+  if (subj.newlines)
+    subj.mem->free(subj.newlines);
 }
 
 // Parse zero or more space characters, including at most one newline.
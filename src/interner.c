@@ -0,0 +1,109 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "interner.h"
+
+#define INITIAL_CAPACITY 64
+
+static uint32_t S_hash(const unsigned char *data, bufsize_t len) {
+  uint32_t hash = 2166136261u;
+  bufsize_t i;
+
+  for (i = 0; i < len; i++) {
+    hash ^= data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+void cmark_interner_init(cmark_interner *interner, cmark_mem *mem) {
+  memset(interner, 0, sizeof(*interner));
+  interner->mem = mem;
+}
+
+void cmark_interner_clear(cmark_interner *interner) {
+  size_t i;
+
+  if (interner->size == 0)
+    return;
+
+  for (i = 0; i < interner->capacity; i++) {
+    struct cmark_interner_entry *entry = &interner->entries[i];
+    cmark_chunk c = {entry->data, entry->len, CMARK_CHUNK_SHARED};
+
+    if (entry->data) {
+      cmark_chunk_free(interner->mem, &c);
+      entry->data = NULL;
+    }
+  }
+  interner->size = 0;
+}
+
+void cmark_interner_free(cmark_interner *interner) {
+  cmark_interner_clear(interner);
+  interner->mem->free(interner->entries);
+  interner->entries = NULL;
+  interner->capacity = 0;
+}
+
+// Double the table, rehashing its entries; the capacity is a power of two.
+static void S_grow(cmark_interner *interner) {
+  struct cmark_interner_entry *old = interner->entries;
+  size_t old_capacity = interner->capacity, i;
+  size_t capacity = old_capacity ? 2 * old_capacity : INITIAL_CAPACITY;
+
+  interner->entries = (struct cmark_interner_entry *)interner->mem->calloc(
+      capacity, sizeof(struct cmark_interner_entry));
+  interner->capacity = capacity;
+
+  for (i = 0; i < old_capacity; i++) {
+    size_t j;
+
+    if (!old[i].data)
+      continue;
+    for (j = old[i].hash & (capacity - 1); interner->entries[j].data;
+         j = (j + 1) & (capacity - 1))
+      ;
+    interner->entries[j] = old[i];
+  }
+  interner->mem->free(old);
+}
+
+cmark_chunk cmark_interner_intern(cmark_interner *interner,
+                                  const unsigned char *data, bufsize_t len) {
+  struct cmark_interner_entry *entry;
+  cmark_chunk c;
+  uint32_t hash;
+  size_t i;
+
+  if (len == 0) {
+    cmark_chunk empty = CMARK_CHUNK_EMPTY;
+    return empty;
+  }
+
+  // Keep the table at most three quarters full.
+  if (4 * (interner->size + 1) > 3 * interner->capacity)
+    S_grow(interner);
+
+  hash = S_hash(data, len);
+  for (i = hash & (interner->capacity - 1);; i = (i + 1) & (interner->capacity - 1)) {
+    entry = &interner->entries[i];
+    if (!entry->data)
+      break;
+    if (entry->hash == hash && entry->len == len &&
+        memcmp(entry->data, data, len) == 0) {
+      c.data = entry->data;
+      c.len = len;
+      c.alloc = CMARK_CHUNK_SHARED;
+      return cmark_chunk_share(interner->mem, &c);
+    }
+  }
+
+  c = cmark_chunk_new_shared(interner->mem, data, len);
+  entry->data = c.data;
+  entry->len = len;
+  entry->hash = hash;
+  interner->size++;
+
+  return cmark_chunk_share(interner->mem, &c);
+}
@@ -463,6 +463,11 @@ char *cmark_render_latex(cmark_node *root, int options, int width) {
   return cmark_render_latex_with_mem(root, options, width, cmark_node_mem(root));
 }
 
+cmark_render_sink *cmark_latex_sink_new(cmark_mem *mem, int options,
+                                        int width) {
+  return cmark_render_sink_new(mem, options, width, 0, outc, S_render_node);
+}
+
 char *cmark_render_latex_with_mem(cmark_node *root, int options, int width, cmark_mem *mem) {
-  return cmark_render(mem, root, options, width, outc, S_render_node);
+  return cmark_render_sink_run(root, cmark_latex_sink_new(mem, options, width));
 }
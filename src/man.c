@@ -273,6 +273,10 @@ char *cmark_render_man(cmark_node *root, int options, int width) {
   return cmark_render_man_with_mem(root, options, width, cmark_node_mem(root));
 }
 
+cmark_render_sink *cmark_man_sink_new(cmark_mem *mem, int options, int width) {
+  return cmark_render_sink_new(mem, options, width, 0, S_outc, S_render_node);
+}
+
 char *cmark_render_man_with_mem(cmark_node *root, int options, int width, cmark_mem *mem) {
-  return cmark_render(mem, root, options, width, S_outc, S_render_node);
+  return cmark_render_sink_run(root, cmark_man_sink_new(mem, options, width));
 }
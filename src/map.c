@@ -1,14 +1,57 @@
+#include <string.h>
+
 #include "map.h"
 #include "utf8.h"
 #include "parser.h"
+#include "cmark_ctype.h"
+
+// Case folding and the replacement of invalid bytes by U+FFFD at most
+// triple the length of a label.
+#define MAX_NORMALIZED_LABEL_LENGTH (3 * MAX_LINK_LABEL_LENGTH)
+
+// Write the normalized form of the 'len' bytes at 'label' to 'dest', which
+// has room for 3 * len + 1 bytes, and return its length.  ASCII, which is
+// most of any label, is folded and has its whitespace collapsed inline.
+static bufsize_t S_normalize_label(const unsigned char *label, bufsize_t len,
+                                   unsigned char *dest) {
+  bufsize_t r = 0, w = 0, n;
+  bool space = false;
+
+  while (r < len) {
+    unsigned char c = label[r];
+
+    if (c < 0x80 && cmark_isspace(c)) {
+      space = w > 0;
+      r++;
+      continue;
+    }
+
+    if (space) {
+      dest[w++] = ' ';
+      space = false;
+    }
+
+    if (c < 0x80) {
+      dest[w++] = c >= 'A' && c <= 'Z' ? c + 32 : c;
+      r++;
+    } else {
+      r += cmark_utf8proc_case_fold_char(label + r, len - r, dest + w, &n);
+      w += n;
+    }
+  }
+
+  dest[w] = '\0';
+  return w;
+}
 
 // normalize map label:  collapse internal whitespace to single space,
 // remove leading/trailing whitespace, case fold
 // Return NULL if the label is actually empty (i.e. composed solely from
 // whitespace)
 unsigned char *normalize_map_label(cmark_mem *mem, cmark_chunk *ref) {
-  cmark_strbuf normalized = CMARK_BUF_INIT(mem);
-  unsigned char *result;
+  unsigned char small[MAX_NORMALIZED_LABEL_LENGTH + 1];
+  unsigned char *buf = small, *result;
+  bufsize_t len;
 
   if (ref == NULL)
     return NULL;
@@ -16,18 +59,20 @@ unsigned char *normalize_map_label(cmark_mem *mem, cmark_chunk *ref) {
   if (ref->len == 0)
     return NULL;
 
-  cmark_utf8proc_case_fold(&normalized, ref->data, ref->len);
-  cmark_strbuf_trim(&normalized);
-  cmark_strbuf_normalize_whitespace(&normalized);
+  if (ref->len > MAX_LINK_LABEL_LENGTH)
+    buf = (unsigned char *)mem->calloc(3 * (size_t)ref->len + 1, 1);
 
-  result = cmark_strbuf_detach(&normalized);
-  assert(result);
+  len = S_normalize_label(ref->data, ref->len, buf);
 
-  if (result[0] == '\0') {
-    mem->free(result);
-    return NULL;
+  if (buf[0] == '\0') {
+    result = NULL;
+  } else {
+    result = (unsigned char *)mem->calloc(len + 1, 1);
+    memcpy(result, buf, len + 1);
   }
 
+  if (buf != small)
+    mem->free(buf);
   return result;
 }
 
@@ -74,7 +119,7 @@ static void sort_map(cmark_map *map) {
 cmark_map_entry *cmark_map_lookup(cmark_map *map, cmark_chunk *label) {
   cmark_map_entry **ref = NULL;
   cmark_map_entry *r = NULL;
-  unsigned char *norm;
+  unsigned char norm[MAX_NORMALIZED_LABEL_LENGTH + 1];
 
   if (label->len < 1 || label->len > MAX_LINK_LABEL_LENGTH)
     return NULL;
@@ -82,15 +127,14 @@ cmark_map_entry *cmark_map_lookup(cmark_map *map, cmark_chunk *label) {
   if (map == NULL || !map->size)
     return NULL;
 
-  norm = normalize_map_label(map->mem, label);
-  if (norm == NULL)
+  S_normalize_label(label->data, label->len, norm);
+  if (norm[0] == '\0')
     return NULL;
 
   if (!map->sorted)
     sort_map(map);
 
   ref = (cmark_map_entry **)bsearch(norm, map->sorted, map->size, sizeof(cmark_map_entry *), refsearch);
-  map->mem->free(norm);
 
   if (ref != NULL) {
     r = ref[0];
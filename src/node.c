@@ -4,6 +4,7 @@
 
 #include "mutex.h"
 #include "node.h"
+#include "iterator.h"
 #include "syntax_extension.h"
 
 CMARK_DEFINE_LOCK(nextflag)
@@ -194,6 +195,12 @@ static void free_node_as(cmark_node *node) {
     cmark_chunk_free(NODE_MEM(node), &node->as.custom.on_enter);
     cmark_chunk_free(NODE_MEM(node), &node->as.custom.on_exit);
       break;
+    case CMARK_NODE_DOCUMENT:
+    if (node->as.document.inline_parser) {
+      cmark_parser_free(node->as.document.inline_parser);
+    }
+    cmark_llist_free(NODE_MEM(node), node->as.document.html_filters);
+      break;
     default:
       break;
     }
@@ -348,6 +355,7 @@ cmark_node *cmark_node_first_child(cmark_node *node) {
   if (node == NULL) {
     return NULL;
   } else {
+    cmark_node_ensure_inlines(node);
     return node->first_child;
   }
 }
@@ -356,6 +364,7 @@ cmark_node *cmark_node_last_child(cmark_node *node) {
   if (node == NULL) {
     return NULL;
   } else {
+    cmark_node_ensure_inlines(node);
     return node->last_child;
   }
 }
@@ -364,6 +373,7 @@ cmark_node *cmark_node_nth_child(cmark_node *node, int n) {
   if (node == NULL) {
     return NULL;
   }
+  cmark_node_ensure_inlines(node);
   int i = 0;
   cmark_node *ret = node->first_child;
   while (ret && i < n) {
@@ -381,6 +391,20 @@ cmark_node *cmark_node_parent_footnote_def(cmark_node *node) {
   }
 }
 
+int cmark_node_get_footnote_ix(cmark_node *node) {
+  if (node == NULL) {
+    return 0;
+  }
+
+  switch (node->type) {
+  case CMARK_NODE_FOOTNOTE_DEFINITION:
+  case CMARK_NODE_FOOTNOTE_REFERENCE:
+    return node->footnote_ix;
+  default:
+    return 0;
+  }
+}
+
 void *cmark_node_get_user_data(cmark_node *node) {
   if (node == NULL) {
     return NULL;
@@ -446,6 +470,8 @@ int cmark_node_set_literal(cmark_node *node, const char *content) {
   case CMARK_NODE_CODE:
   case CMARK_NODE_FOOTNOTE_REFERENCE:
     cmark_chunk_set_cstr(NODE_MEM(node), &node->as.literal, content);
+    // The new HTML hasn't been checked against the html filters.
+    node->flags &= ~CMARK_NODE__HTML_UNFILTERED;
     return 1;
 
   case CMARK_NODE_CODE_BLOCK:
@@ -899,6 +925,25 @@ int cmark_node_get_end_column(cmark_node *node) {
   return node->end_column;
 }
 
+// Parse all inlines still pending below 'node' before it is moved out of
+// its document, which owns what is needed to parse them.
+static void S_detach_pending_inlines(cmark_node *node) {
+  cmark_node *root = node->parent;
+  cmark_iter iter;
+
+  if (root == NULL)
+    return;
+  while (root->parent)
+    root = root->parent;
+  if (root->type != CMARK_NODE_DOCUMENT || !root->as.document.inline_parser)
+    return;
+
+  // Iterating over the subtree parses the pending inlines.
+  cmark_iter_init(&iter, node);
+  while (cmark_iter_next(&iter) != CMARK_EVENT_DONE)
+    ;
+}
+
 // Unlink a node without adjusting its next, prev, and parent pointers.
 static void S_node_unlink(cmark_node *node) {
   if (node == NULL) {
@@ -925,6 +970,7 @@ static void S_node_unlink(cmark_node *node) {
 }
 
 void cmark_node_unlink(cmark_node *node) {
+  S_detach_pending_inlines(node);
   S_node_unlink(node);
 
   node->next = NULL;
@@ -941,6 +987,7 @@ int cmark_node_insert_before(cmark_node *node, cmark_node *sibling) {
     return 0;
   }
 
+  S_detach_pending_inlines(sibling);
   S_node_unlink(sibling);
 
   cmark_node *old_prev = node->prev;
@@ -974,6 +1021,7 @@ int cmark_node_insert_after(cmark_node *node, cmark_node *sibling) {
     return 0;
   }
 
+  S_detach_pending_inlines(sibling);
   S_node_unlink(sibling);
 
   cmark_node *old_next = node->next;
@@ -1011,6 +1059,8 @@ int cmark_node_prepend_child(cmark_node *node, cmark_node *child) {
     return 0;
   }
 
+  cmark_node_ensure_inlines(node);
+  S_detach_pending_inlines(child);
   S_node_unlink(child);
 
   cmark_node *old_first_child = node->first_child;
@@ -1035,6 +1085,8 @@ int cmark_node_append_child(cmark_node *node, cmark_node *child) {
     return 0;
   }
 
+  cmark_node_ensure_inlines(node);
+  S_detach_pending_inlines(child);
   S_node_unlink(child);
 
   cmark_node *old_last_child = node->last_child;
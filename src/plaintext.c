@@ -182,7 +182,9 @@ static int S_render_node(cmark_renderer *renderer, cmark_node *node,
   case CMARK_NODE_FOOTNOTE_REFERENCE:
     if (entering) {
       LIT("[^");
-      OUT(cmark_chunk_to_cstr(renderer->mem, &node->as.literal), false, LITERAL);
+      char n[32];
+      snprintf(n, sizeof(n), "%d", node->footnote_ix);
+      OUT(n, false, LITERAL);
       LIT("]");
     }
     break;
@@ -213,11 +215,17 @@ char *cmark_render_plaintext(cmark_node *root, int options, int width) {
   return cmark_render_plaintext_with_mem(root, options, width, cmark_node_mem(root));
 }
 
-char *cmark_render_plaintext_with_mem(cmark_node *root, int options, int width, cmark_mem *mem) {
+cmark_render_sink *cmark_plaintext_sink_new(cmark_mem *mem, int options,
+                                            int width) {
   if (options & CMARK_OPT_HARDBREAKS) {
     // disable breaking on width, since it has
     // a different meaning with OPT_HARDBREAKS
     width = 0;
   }
-  return cmark_render(mem, root, options, width, outc, S_render_node);
+  return cmark_render_sink_new(mem, options, width, 0, outc, S_render_node);
+}
+
+char *cmark_render_plaintext_with_mem(cmark_node *root, int options, int width, cmark_mem *mem) {
+  return cmark_render_sink_run(root,
+                               cmark_plaintext_sink_new(mem, options, width));
 }
@@ -21,6 +21,7 @@ static void reference_free(cmark_map *map, cmark_map_entry *_ref) {
 void cmark_reference_create(cmark_map *map, cmark_chunk *label,
                             cmark_chunk *url, cmark_chunk *title) {
   cmark_reference *ref;
+  cmark_chunk cleaned;
   unsigned char *reflabel = normalize_map_label(map->mem, label);
 
   /* empty reference name, or composed from only whitespace */
@@ -32,8 +33,13 @@ void cmark_reference_create(cmark_map *map, cmark_chunk *label,
   ref = (cmark_reference *)map->mem->calloc(1, sizeof(*ref));
   ref->entry.label = reflabel;
   ref->is_attributes_reference = false;
-  ref->url = cmark_clean_url(map->mem, url);
-  ref->title = cmark_clean_title(map->mem, title);
+  // Links to the reference share its destination and title.
+  cleaned = cmark_clean_url(map->mem, url);
+  ref->url = cmark_chunk_share(map->mem, &cleaned);
+  cmark_chunk_free(map->mem, &cleaned);
+  cleaned = cmark_clean_title(map->mem, title);
+  ref->title = cmark_chunk_share(map->mem, &cleaned);
+  cmark_chunk_free(map->mem, &cleaned);
   ref->attributes = cmark_chunk_literal("");
   ref->entry.age = map->size;
   ref->entry.next = map->refs;
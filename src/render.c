@@ -1,4 +1,5 @@
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "buffer.h"
@@ -6,6 +7,7 @@
 #include "cmark-gfm.h"
 #include "utf8.h"
 #include "render.h"
+#include "iterator.h"
 #include "node.h"
 #include "syntax_extension.h"
 
@@ -157,6 +159,127 @@ void cmark_render_code_point(cmark_renderer *renderer, uint32_t c) {
   renderer->column += 1;
 }
 
+bufsize_t cmark_render_size_hint(cmark_node *root, size_t capacity,
+                                 size_t bytes_per_node) {
+  if (capacity == 0 && root != NULL && root->type == CMARK_NODE_DOCUMENT) {
+    capacity = root->as.document.source_size +
+               root->as.document.node_count * bytes_per_node;
+  }
+
+  // This is only a hint: never ask for more than cmark_strbuf_grow allows.
+  if (capacity > INT32_MAX / 2)
+    capacity = INT32_MAX / 2;
+
+  return (bufsize_t)capacity;
+}
+
+typedef struct {
+  cmark_render_sink sink;
+  cmark_renderer renderer;
+  cmark_strbuf pref;
+  cmark_strbuf buf;
+  int options;
+  int (*render_node)(cmark_renderer *renderer, cmark_node *node,
+                     cmark_event_type ev_type, int options);
+} renderer_sink;
+
+static int S_sink_render_node(cmark_render_sink *sink, cmark_node *cur,
+                              cmark_event_type ev_type) {
+  renderer_sink *rs = (renderer_sink *)sink;
+
+  if (cur->extension) {
+    cur->ancestor_extension = cur->extension;
+  } else if (cur->parent) {
+    cur->ancestor_extension = cur->parent->ancestor_extension;
+  }
+  if (cur->type == CMARK_NODE_ITEM) {
+    // Calculate the list item's index, for the benefit of output formats
+    // like commonmark and plaintext.
+    if (cur->prev) {
+      cmark_node_set_item_index(cur, 1 + cmark_node_get_item_index(cur->prev));
+    } else {
+      cmark_node_set_item_index(cur, cmark_node_get_list_start(cur->parent));
+    }
+  }
+  // a false value causes us to skip processing
+  // the node's contents.  this is used for
+  // autolinks.
+  return rs->render_node(&rs->renderer, cur, ev_type, rs->options);
+}
+
+static char *S_sink_finish(cmark_render_sink *sink) {
+  renderer_sink *rs = (renderer_sink *)sink;
+  cmark_mem *mem = rs->renderer.mem;
+  char *result;
+
+  // ensure final newline
+  if (rs->buf.size == 0 || rs->buf.ptr[rs->buf.size - 1] != '\n') {
+    cmark_strbuf_putc(&rs->buf, '\n');
+  }
+
+  result = (char *)cmark_strbuf_detach(&rs->buf);
+
+  cmark_strbuf_free(&rs->pref);
+  cmark_strbuf_free(&rs->buf);
+  mem->free(rs);
+
+  return result;
+}
+
+cmark_render_sink *cmark_render_sink_new(
+    cmark_mem *mem, int options, int width, bufsize_t capacity,
+    void (*outc)(cmark_renderer *, cmark_node *, cmark_escaping, int32_t,
+                 unsigned char),
+    int (*render_node)(cmark_renderer *renderer, cmark_node *node,
+                       cmark_event_type ev_type, int options)) {
+  renderer_sink *rs = (renderer_sink *)mem->calloc(1, sizeof(*rs));
+
+  rs->sink.render_node = S_sink_render_node;
+  rs->sink.finish = S_sink_finish;
+  rs->options = options;
+  rs->render_node = render_node;
+  cmark_strbuf_init(mem, &rs->pref, 0);
+  cmark_strbuf_init(mem, &rs->buf, capacity);
+
+  cmark_renderer renderer = {mem,   &rs->buf, &rs->pref, 0,           width,
+                             0,     0,        true,      true,        false,
+                             false, outc,     S_cr,      S_blankline, S_out,
+                             0};
+  rs->renderer = renderer;
+
+  return &rs->sink;
+}
+
+void cmark_render_sinks(cmark_node *root, cmark_render_sink **sinks,
+                        size_t n_sinks) {
+  cmark_iter iter;
+  cmark_event_type ev_type;
+  cmark_node *cur;
+  size_t i;
+
+  cmark_iter_init(&iter, root);
+  while ((ev_type = cmark_iter_next(&iter)) != CMARK_EVENT_DONE) {
+    cur = cmark_iter_get_node(&iter);
+    for (i = 0; i < n_sinks; ++i) {
+      cmark_render_sink *sink = sinks[i];
+      if (sink->skip) {
+        // The exit event of a skipped node isn't rendered either.
+        if (sink->skip == cur && ev_type == CMARK_EVENT_EXIT)
+          sink->skip = NULL;
+        continue;
+      }
+      if (!sink->render_node(sink, cur, ev_type) &&
+          ev_type == CMARK_EVENT_ENTER && !cmark_iter_is_leaf(cur))
+        sink->skip = cur;
+    }
+  }
+}
+
+char *cmark_render_sink_run(cmark_node *root, cmark_render_sink *sink) {
+  cmark_render_sinks(root, &sink, 1);
+  return sink->finish(sink);
+}
+
 char *cmark_render(cmark_mem *mem, cmark_node *root, int options, int width,
                    void (*outc)(cmark_renderer *, cmark_node *,
                                 cmark_escaping, int32_t,
@@ -164,52 +287,57 @@ char *cmark_render(cmark_mem *mem, cmark_node *root, int options, int width,
                    int (*render_node)(cmark_renderer *renderer,
                                       cmark_node *node,
                                       cmark_event_type ev_type, int options)) {
-  cmark_strbuf pref = CMARK_BUF_INIT(mem);
-  cmark_strbuf buf = CMARK_BUF_INIT(mem);
-  cmark_node *cur;
-  cmark_event_type ev_type;
-  char *result;
-  cmark_iter *iter = cmark_iter_new(root);
-
-  cmark_renderer renderer = {mem,   &buf, &pref, 0,           width,
-                             0,     0,    true,  true,        false,
-                             false, outc, S_cr,  S_blankline, S_out,
-                             0};
+  return cmark_render_sink_run(
+      root, cmark_render_sink_new(mem, options, width, 0, outc, render_node));
+}
 
-  while ((ev_type = cmark_iter_next(iter)) != CMARK_EVENT_DONE) {
-    cur = cmark_iter_get_node(iter);
-    if (cur->extension) {
-      cur->ancestor_extension = cur->extension;
-    } else if (cur->parent) {
-      cur->ancestor_extension = cur->parent->ancestor_extension;
-    }
-    if (cur->type == CMARK_NODE_ITEM) {
-      // Calculate the list item's index, for the benefit of output formats
-      // like commonmark and plaintext.
-      if (cur->prev) {
-        cmark_node_set_item_index(cur, 1 + cmark_node_get_item_index(cur->prev));
-      } else {
-        cmark_node_set_item_index(cur, cmark_node_get_list_start(cur->parent));
-      }
-    }
-    if (!render_node(&renderer, cur, ev_type, options)) {
-      // a false value causes us to skip processing
-      // the node's contents.  this is used for
-      // autolinks.
-      cmark_iter_reset(iter, cur, CMARK_EVENT_EXIT);
-    }
+static cmark_render_sink *S_target_sink(cmark_mem *mem, cmark_node *root,
+                                        cmark_render_target *target) {
+  switch (target->format) {
+  case CMARK_FORMAT_HTML:
+    return cmark_html_sink_new(mem, root, target->options, target->extensions,
+                               0);
+  case CMARK_FORMAT_XML:
+    return cmark_xml_sink_new(mem, root, target->options, 0);
+  case CMARK_FORMAT_MAN:
+    return cmark_man_sink_new(mem, target->options, target->width);
+  case CMARK_FORMAT_COMMONMARK:
+    return cmark_commonmark_sink_new(mem, root, target->options, target->width,
+                                     0);
+  case CMARK_FORMAT_PLAINTEXT:
+    return cmark_plaintext_sink_new(mem, target->options, target->width);
+  case CMARK_FORMAT_LATEX:
+    return cmark_latex_sink_new(mem, target->options, target->width);
   }
+  return NULL;
+}
 
-  // ensure final newline
-  if (renderer.buffer->size == 0 || renderer.buffer->ptr[renderer.buffer->size - 1] != '\n') {
-    cmark_strbuf_putc(renderer.buffer, '\n');
+int cmark_render_multi_with_mem(cmark_node *root, cmark_render_target *targets,
+                                size_t n_targets, cmark_mem *mem) {
+  cmark_render_sink **sinks;
+  size_t i;
+
+  for (i = 0; i < n_targets; ++i) {
+    targets[i].result = NULL;
+    if ((unsigned)targets[i].format > CMARK_FORMAT_LATEX)
+      return 0;
   }
 
-  result = (char *)cmark_strbuf_detach(renderer.buffer);
+  sinks = (cmark_render_sink **)mem->calloc(n_targets + 1, sizeof(*sinks));
+  for (i = 0; i < n_targets; ++i)
+    sinks[i] = S_target_sink(mem, root, &targets[i]);
 
-  cmark_iter_free(iter);
-  cmark_strbuf_free(renderer.prefix);
-  cmark_strbuf_free(renderer.buffer);
+  cmark_render_sinks(root, sinks, n_targets);
 
-  return result;
+  for (i = 0; i < n_targets; ++i)
+    targets[i].result = sinks[i]->finish(sinks[i]);
+
+  mem->free(sinks);
+  return 1;
+}
+
+int cmark_render_multi(cmark_node *root, cmark_render_target *targets,
+                       size_t n_targets) {
+  return cmark_render_multi_with_mem(root, targets, n_targets,
+                                     cmark_node_mem(root));
 }
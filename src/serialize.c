@@ -0,0 +1,684 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cmark-gfm.h"
+#include "node.h"
+#include "buffer.h"
+#include "chunk.h"
+#include "syntax_extension.h"
+
+// Binary serialization of node trees.
+//
+// The tree is written in document order.  Each node is a record followed by
+// the records of its children and a zero byte closing the list of children.
+// A record starts with the node type, which is never zero, and continues
+// with:
+//
+//   - the syntax extension: 0 for none, the 1-based index of an extension
+//     already seen in the stream, or the next index followed by the name of
+//     the extension when it appears for the first time;
+//   - the source position and internal flags;
+//   - the fields of 'as' used by the node type;
+//   - for nodes with an extension, the extension's opaque data.
+//
+// Integers are LEB128 varints, zigzag encoded when they can be negative.
+// Strings are a varint length followed by the bytes.  The only exception
+// is the link from a footnote reference to its definition, which is a
+// fixed-size index among the definitions so it can be patched in once all
+// definitions have been seen.
+
+#define SERIALIZE_MAGIC "CMKB"
+#define SERIALIZE_MAGIC_LEN 4
+#define SERIALIZE_VERSION 2
+
+// Room for the opaque data of most extension nodes.
+#define OPAQUE_BUFFER_SIZE 64
+
+typedef struct {
+  cmark_node *node;
+  bufsize_t pos;
+} footnote_fixup;
+
+typedef struct {
+  cmark_node *node;
+  uint32_t index;
+} footnote_link;
+
+typedef struct {
+  cmark_mem *mem;
+  cmark_strbuf *buf;
+  cmark_syntax_extension **extensions;
+  size_t n_extensions;
+  cmark_node **footnote_defs;
+  size_t n_footnote_defs;
+  footnote_fixup *fixups;
+  size_t n_fixups;
+  unsigned char *opaque;
+  size_t opaque_size;
+} writer;
+
+static void *grow_array(cmark_mem *mem, void *ptr, size_t count,
+                        size_t elem_size) {
+  // Double the capacity whenever 'count' reaches a power of two.
+  if (count == 0 || (count & (count - 1)) == 0)
+    return mem->realloc(ptr, (count ? count * 2 : 4) * elem_size);
+  return ptr;
+}
+
+static void write_uint(cmark_strbuf *buf, uint64_t value) {
+  unsigned char bytes[10];
+  int len = 0;
+
+  do {
+    bytes[len] = (unsigned char)(value & 0x7f);
+    value >>= 7;
+    if (value)
+      bytes[len] |= 0x80;
+    len++;
+  } while (value);
+
+  cmark_strbuf_put(buf, bytes, len);
+}
+
+static void write_int(cmark_strbuf *buf, int64_t value) {
+  write_uint(buf, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+static void write_bytes(cmark_strbuf *buf, const unsigned char *data,
+                        size_t len) {
+  write_uint(buf, len);
+  cmark_strbuf_put(buf, data, (bufsize_t)len);
+}
+
+static void write_chunk(cmark_strbuf *buf, cmark_chunk *chunk) {
+  write_bytes(buf, chunk->data, chunk->len);
+}
+
+static void write_extension(writer *w, cmark_syntax_extension *ext) {
+  size_t i;
+
+  if (ext == NULL) {
+    write_uint(w->buf, 0);
+    return;
+  }
+
+  for (i = 0; i < w->n_extensions; ++i) {
+    if (w->extensions[i] == ext) {
+      write_uint(w->buf, i + 1);
+      return;
+    }
+  }
+
+  w->extensions = (cmark_syntax_extension **)grow_array(
+      w->mem, w->extensions, w->n_extensions, sizeof(*w->extensions));
+  w->extensions[w->n_extensions++] = ext;
+  write_uint(w->buf, w->n_extensions);
+  write_bytes(w->buf, (const unsigned char *)ext->name, strlen(ext->name));
+}
+
+static void write_opaque(writer *w, cmark_node *node) {
+  cmark_syntax_extension *ext = node->extension;
+  size_t len = 0;
+
+  if (ext->opaque_serialize_func) {
+    len = ext->opaque_serialize_func(ext, node, w->opaque, w->opaque_size);
+    if (len > w->opaque_size) {
+      w->opaque = (unsigned char *)w->mem->realloc(w->opaque, len);
+      w->opaque_size = len;
+      len = ext->opaque_serialize_func(ext, node, w->opaque, w->opaque_size);
+    }
+  }
+
+  write_bytes(w->buf, w->opaque, len);
+}
+
+static void write_footnote_def(writer *w, cmark_node *def) {
+  w->fixups = (footnote_fixup *)grow_array(w->mem, w->fixups, w->n_fixups,
+                                           sizeof(*w->fixups));
+  w->fixups[w->n_fixups].node = def;
+  w->fixups[w->n_fixups].pos = w->buf->size;
+  w->n_fixups++;
+
+  // Placeholder for the 1-based index of the definition, 0 for none.
+  cmark_strbuf_put(w->buf, (const unsigned char *)"\0\0\0\0", 4);
+}
+
+static void write_node(writer *w, cmark_node *node) {
+  cmark_strbuf *buf = w->buf;
+
+  write_uint(buf, node->type);
+  write_extension(w, node->extension);
+  write_int(buf, node->start_line);
+  write_int(buf, node->start_column);
+  write_int(buf, node->end_line);
+  write_int(buf, node->end_column);
+  write_uint(buf, node->flags & ~(CMARK_NODE__INLINES_PENDING |
+                                   CMARK_NODE__HTML_UNFILTERED));
+
+  switch (node->type) {
+  case CMARK_NODE_DOCUMENT:
+    write_uint(buf, node->as.document.source_size);
+    write_uint(buf, node->as.document.node_count);
+    break;
+  case CMARK_NODE_TEXT:
+  case CMARK_NODE_HTML_INLINE:
+  case CMARK_NODE_HTML_BLOCK:
+    write_chunk(buf, &node->as.literal);
+    break;
+  case CMARK_NODE_CODE:
+    write_chunk(buf, &node->as.literal);
+    write_uint(buf, node->backtick_count);
+    break;
+  case CMARK_NODE_FOOTNOTE_DEFINITION:
+    write_chunk(buf, &node->as.literal);
+    write_int(buf, node->footnote.def_count);
+    write_int(buf, node->footnote_ix);
+    w->footnote_defs = (cmark_node **)grow_array(
+        w->mem, w->footnote_defs, w->n_footnote_defs, sizeof(*w->footnote_defs));
+    w->footnote_defs[w->n_footnote_defs++] = node;
+    break;
+  case CMARK_NODE_FOOTNOTE_REFERENCE:
+    write_chunk(buf, &node->as.literal);
+    write_int(buf, node->footnote.ref_ix);
+    write_int(buf, node->footnote_ix);
+    write_footnote_def(w, node->parent_footnote_def);
+    break;
+  case CMARK_NODE_CODE_BLOCK:
+    write_chunk(buf, &node->as.code.info);
+    write_chunk(buf, &node->as.code.literal);
+    write_uint(buf, node->as.code.fence_length);
+    write_uint(buf, node->as.code.fence_offset);
+    write_uint(buf, node->as.code.fence_char);
+    write_int(buf, node->as.code.fenced);
+    break;
+  case CMARK_NODE_LIST:
+  case CMARK_NODE_ITEM:
+    write_uint(buf, node->as.list.list_type);
+    write_int(buf, node->as.list.marker_offset);
+    write_int(buf, node->as.list.padding);
+    write_int(buf, node->as.list.start);
+    write_uint(buf, node->as.list.delimiter);
+    write_uint(buf, node->as.list.bullet_char);
+    write_uint(buf, node->as.list.tight);
+    write_uint(buf, node->as.list.checked);
+    break;
+  case CMARK_NODE_HEADING:
+    write_int(buf, node->as.heading.level);
+    write_uint(buf, node->as.heading.setext);
+    break;
+  case CMARK_NODE_LINK:
+  case CMARK_NODE_IMAGE:
+    write_chunk(buf, &node->as.link.url);
+    write_chunk(buf, &node->as.link.title);
+    break;
+  case CMARK_NODE_ATTRIBUTE:
+    write_chunk(buf, &node->as.attribute.attributes);
+    break;
+  case CMARK_NODE_CUSTOM_BLOCK:
+  case CMARK_NODE_CUSTOM_INLINE:
+    write_chunk(buf, &node->as.custom.on_enter);
+    write_chunk(buf, &node->as.custom.on_exit);
+    break;
+  default:
+    break;
+  }
+
+  if (node->extension)
+    write_opaque(w, node);
+}
+
+static int compare_footnote_links(const void *a, const void *b) {
+  uintptr_t x = (uintptr_t)((const footnote_link *)a)->node;
+  uintptr_t y = (uintptr_t)((const footnote_link *)b)->node;
+  return x < y ? -1 : x > y;
+}
+
+// Fill in the definition index of every footnote reference.
+static void patch_footnote_defs(writer *w) {
+  footnote_link *sorted;
+  size_t i;
+
+  if (w->n_fixups == 0)
+    return;
+
+  // Look the definitions up by address, remembering their position in the
+  // document.
+  sorted = (footnote_link *)w->mem->calloc(w->n_footnote_defs + 1,
+                                           sizeof(*sorted));
+  for (i = 0; i < w->n_footnote_defs; ++i) {
+    sorted[i].node = w->footnote_defs[i];
+    sorted[i].index = (uint32_t)(i + 1);
+  }
+  qsort(sorted, w->n_footnote_defs, sizeof(*sorted), compare_footnote_links);
+
+  for (i = 0; i < w->n_fixups; ++i) {
+    footnote_link key = {w->fixups[i].node, 0};
+    footnote_link *found = NULL;
+    uint32_t index = 0;
+    unsigned char *p = w->buf->ptr + w->fixups[i].pos;
+
+    if (key.node)
+      found = (footnote_link *)bsearch(&key, sorted, w->n_footnote_defs,
+                                       sizeof(*sorted), compare_footnote_links);
+    if (found)
+      index = found->index;
+
+    p[0] = (unsigned char)(index & 0xff);
+    p[1] = (unsigned char)((index >> 8) & 0xff);
+    p[2] = (unsigned char)((index >> 16) & 0xff);
+    p[3] = (unsigned char)((index >> 24) & 0xff);
+  }
+
+  w->mem->free(sorted);
+}
+
+char *cmark_serialize(cmark_node *root, size_t *len) {
+  cmark_mem *mem = root->content.mem;
+  cmark_strbuf buf = CMARK_BUF_INIT(mem);
+  writer w;
+  cmark_node *node = root;
+
+  memset(&w, 0, sizeof(w));
+  w.mem = mem;
+  w.buf = &buf;
+  w.opaque_size = OPAQUE_BUFFER_SIZE;
+  w.opaque = (unsigned char *)mem->calloc(1, w.opaque_size);
+
+  cmark_strbuf_put(&buf, (const unsigned char *)SERIALIZE_MAGIC,
+                   SERIALIZE_MAGIC_LEN);
+  write_uint(&buf, SERIALIZE_VERSION);
+
+  for (;;) {
+    write_node(&w, node);
+
+    cmark_node_ensure_inlines(node);
+    if (node->first_child) {
+      node = node->first_child;
+      continue;
+    }
+
+    cmark_strbuf_putc(&buf, 0);
+    while (node != root && node->next == NULL) {
+      node = node->parent;
+      cmark_strbuf_putc(&buf, 0);
+    }
+    if (node == root)
+      break;
+    node = node->next;
+  }
+
+  patch_footnote_defs(&w);
+
+  mem->free(w.extensions);
+  mem->free(w.footnote_defs);
+  mem->free(w.fixups);
+  mem->free(w.opaque);
+
+  *len = (size_t)buf.size;
+  return (char *)cmark_strbuf_detach(&buf);
+}
+
+typedef struct {
+  cmark_mem *mem;
+  const unsigned char *p;
+  const unsigned char *end;
+  cmark_syntax_extension **extensions;
+  size_t n_extensions;
+  cmark_node **footnote_defs;
+  size_t n_footnote_defs;
+  footnote_link *links;
+  size_t n_links;
+} reader;
+
+static bool read_uint(reader *r, uint64_t *value) {
+  uint64_t result = 0;
+  int shift = 0;
+
+  while (r->p < r->end && shift < 64) {
+    unsigned char byte = *r->p++;
+    result |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return true;
+    }
+    shift += 7;
+  }
+
+  return false;
+}
+
+static bool read_int(reader *r, int *value) {
+  uint64_t u;
+  int64_t v;
+
+  if (!read_uint(r, &u))
+    return false;
+  v = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+  if (v < INT32_MIN || v > INT32_MAX)
+    return false;
+  *value = (int)v;
+  return true;
+}
+
+static bool read_small(reader *r, uint64_t max, uint64_t *value) {
+  return read_uint(r, value) && *value <= max;
+}
+
+static bool read_bytes(reader *r, const unsigned char **data, size_t *len) {
+  uint64_t n;
+
+  if (!read_uint(r, &n) || n > (uint64_t)(r->end - r->p))
+    return false;
+  *data = r->p;
+  *len = (size_t)n;
+  r->p += n;
+  return true;
+}
+
+static bool read_chunk(reader *r, cmark_chunk *chunk) {
+  const unsigned char *data;
+  size_t len;
+
+  if (!read_bytes(r, &data, &len) || len >= INT32_MAX)
+    return false;
+
+  cmark_chunk_free(r->mem, chunk);
+  chunk->data = (unsigned char *)r->mem->calloc(len + 1, 1);
+  if (len)
+    memcpy(chunk->data, data, len);
+  chunk->len = (bufsize_t)len;
+  chunk->alloc = (bufsize_t)len + 1;
+  return true;
+}
+
+static bool read_extension(reader *r, cmark_syntax_extension **ext) {
+  uint64_t index;
+  const unsigned char *name;
+  size_t len;
+  char *cname;
+
+  if (!read_uint(r, &index) || index > r->n_extensions + 1)
+    return false;
+
+  if (index == 0) {
+    *ext = NULL;
+    return true;
+  }
+
+  if (index <= r->n_extensions) {
+    *ext = r->extensions[index - 1];
+    return true;
+  }
+
+  if (!read_bytes(r, &name, &len))
+    return false;
+  cname = (char *)r->mem->calloc(len + 1, 1);
+  memcpy(cname, name, len);
+  *ext = cmark_find_syntax_extension(cname);
+  r->mem->free(cname);
+  if (*ext == NULL)
+    return false;
+
+  r->extensions = (cmark_syntax_extension **)grow_array(
+      r->mem, r->extensions, r->n_extensions, sizeof(*r->extensions));
+  r->extensions[r->n_extensions++] = *ext;
+  return true;
+}
+
+static bool valid_type(uint64_t type) {
+  uint64_t value = type & CMARK_NODE_VALUE_MASK;
+
+  if (type > UINT16_MAX || value == 0)
+    return false;
+  if ((type & CMARK_NODE_TYPE_MASK) == CMARK_NODE_TYPE_BLOCK)
+    return type <= (uint64_t)CMARK_NODE_LAST_BLOCK;
+  if ((type & CMARK_NODE_TYPE_MASK) == CMARK_NODE_TYPE_INLINE)
+    return type <= (uint64_t)CMARK_NODE_LAST_INLINE;
+  return false;
+}
+
+// Read the record of a node of the given type, after its type, into a node
+// already linked into the tree so that it is freed with it on failure.
+static bool read_fields(reader *r, cmark_node *node) {
+  uint64_t u;
+  cmark_syntax_extension *ext = node->extension;
+
+  if (!read_int(r, &node->start_line) || !read_int(r, &node->start_column) ||
+      !read_int(r, &node->end_line) || !read_int(r, &node->end_column) ||
+      !read_small(r, UINT16_MAX, &u))
+    return false;
+  node->flags = (cmark_node_internal_flags)u &
+                ~(CMARK_NODE__INLINES_PENDING | CMARK_NODE__HTML_UNFILTERED);
+
+  switch (node->type) {
+  case CMARK_NODE_DOCUMENT:
+    if (!read_uint(r, &u))
+      return false;
+    node->as.document.source_size = (size_t)u;
+    if (!read_uint(r, &u))
+      return false;
+    node->as.document.node_count = (size_t)u;
+    break;
+  case CMARK_NODE_TEXT:
+  case CMARK_NODE_HTML_INLINE:
+  case CMARK_NODE_HTML_BLOCK:
+    if (!read_chunk(r, &node->as.literal))
+      return false;
+    break;
+  case CMARK_NODE_CODE:
+    if (!read_chunk(r, &node->as.literal) || !read_small(r, INT32_MAX, &u))
+      return false;
+    node->backtick_count = (int)u;
+    break;
+  case CMARK_NODE_FOOTNOTE_DEFINITION:
+    if (!read_chunk(r, &node->as.literal) ||
+        !read_int(r, &node->footnote.def_count) ||
+        !read_int(r, &node->footnote_ix))
+      return false;
+    r->footnote_defs = (cmark_node **)grow_array(
+        r->mem, r->footnote_defs, r->n_footnote_defs, sizeof(*r->footnote_defs));
+    r->footnote_defs[r->n_footnote_defs++] = node;
+    break;
+  case CMARK_NODE_FOOTNOTE_REFERENCE:
+    if (!read_chunk(r, &node->as.literal) ||
+        !read_int(r, &node->footnote.ref_ix) ||
+        !read_int(r, &node->footnote_ix) || r->end - r->p < 4)
+      return false;
+    r->links = (footnote_link *)grow_array(r->mem, r->links, r->n_links,
+                                           sizeof(*r->links));
+    r->links[r->n_links].node = node;
+    r->links[r->n_links].index = (uint32_t)r->p[0] | (uint32_t)r->p[1] << 8 |
+                                 (uint32_t)r->p[2] << 16 |
+                                 (uint32_t)r->p[3] << 24;
+    r->n_links++;
+    r->p += 4;
+    break;
+  case CMARK_NODE_CODE_BLOCK:
+    if (!read_chunk(r, &node->as.code.info) ||
+        !read_chunk(r, &node->as.code.literal))
+      return false;
+    if (!read_small(r, UINT8_MAX, &u))
+      return false;
+    node->as.code.fence_length = (uint8_t)u;
+    if (!read_small(r, UINT8_MAX, &u))
+      return false;
+    node->as.code.fence_offset = (uint8_t)u;
+    if (!read_small(r, UINT8_MAX, &u))
+      return false;
+    node->as.code.fence_char = (unsigned char)u;
+    {
+      int fenced;
+      if (!read_int(r, &fenced) || fenced < INT8_MIN || fenced > INT8_MAX)
+        return false;
+      node->as.code.fenced = (int8_t)fenced;
+    }
+    break;
+  case CMARK_NODE_LIST:
+  case CMARK_NODE_ITEM:
+    if (!read_small(r, CMARK_ORDERED_LIST, &u))
+      return false;
+    node->as.list.list_type = (cmark_list_type)u;
+    if (!read_int(r, &node->as.list.marker_offset) ||
+        !read_int(r, &node->as.list.padding) ||
+        !read_int(r, &node->as.list.start) || node->as.list.start < 0)
+      return false;
+    if (!read_small(r, CMARK_PAREN_DELIM, &u))
+      return false;
+    node->as.list.delimiter = (cmark_delim_type)u;
+    if (!read_small(r, UINT8_MAX, &u))
+      return false;
+    node->as.list.bullet_char = (unsigned char)u;
+    if (!read_small(r, 1, &u))
+      return false;
+    node->as.list.tight = u != 0;
+    if (!read_small(r, 1, &u))
+      return false;
+    node->as.list.checked = u != 0;
+    break;
+  case CMARK_NODE_HEADING:
+    if (!read_int(r, &node->as.heading.level) ||
+        node->as.heading.level < 1 || node->as.heading.level > 6 ||
+        !read_small(r, 1, &u))
+      return false;
+    node->as.heading.setext = u != 0;
+    break;
+  case CMARK_NODE_LINK:
+  case CMARK_NODE_IMAGE:
+    if (!read_chunk(r, &node->as.link.url) ||
+        !read_chunk(r, &node->as.link.title))
+      return false;
+    break;
+  case CMARK_NODE_ATTRIBUTE:
+    if (!read_chunk(r, &node->as.attribute.attributes))
+      return false;
+    break;
+  case CMARK_NODE_CUSTOM_BLOCK:
+  case CMARK_NODE_CUSTOM_INLINE:
+    if (!read_chunk(r, &node->as.custom.on_enter) ||
+        !read_chunk(r, &node->as.custom.on_exit))
+      return false;
+    break;
+  default:
+    break;
+  }
+
+  if (ext) {
+    const unsigned char *data;
+    size_t len;
+
+    if (!read_bytes(r, &data, &len))
+      return false;
+    if (ext->opaque_deserialize_func) {
+      if (!ext->opaque_deserialize_func(ext, r->mem, node, data, len))
+        return false;
+    } else if (len) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Link every footnote reference to its definition.
+static bool resolve_footnote_defs(reader *r) {
+  size_t i;
+
+  for (i = 0; i < r->n_links; ++i) {
+    uint32_t index = r->links[i].index;
+    if (index > r->n_footnote_defs)
+      return false;
+    r->links[i].node->parent_footnote_def =
+        index ? r->footnote_defs[index - 1] : NULL;
+  }
+
+  return true;
+}
+
+static cmark_node *read_tree(reader *r) {
+  cmark_node *root = NULL;
+  cmark_node *parent = NULL;
+  cmark_node *node;
+  cmark_syntax_extension *ext;
+  uint64_t type;
+
+  for (;;) {
+    if (!read_uint(r, &type))
+      goto fail;
+
+    if (type == 0) {
+      if (parent == NULL)
+        goto fail;
+      parent = parent->parent;
+      if (parent == NULL)
+        break;
+      continue;
+    }
+
+    if (!valid_type(type) || !read_extension(r, &ext))
+      goto fail;
+    if (parent && !cmark_node_can_contain_type(parent, (cmark_node_type)type))
+      goto fail;
+
+    node = cmark_node_new_with_mem_and_ext((cmark_node_type)type, r->mem, ext);
+
+    if (parent) {
+      node->parent = parent;
+      node->prev = parent->last_child;
+      if (parent->last_child)
+        parent->last_child->next = node;
+      else
+        parent->first_child = node;
+      parent->last_child = node;
+    } else {
+      root = node;
+    }
+
+    if (!read_fields(r, node))
+      goto fail;
+    parent = node;
+  }
+
+  if (r->p != r->end || !resolve_footnote_defs(r))
+    goto fail;
+
+  return root;
+
+fail:
+  if (root)
+    cmark_node_free(root);
+  return NULL;
+}
+
+cmark_node *cmark_deserialize_with_mem(const char *data, size_t len,
+                                       cmark_mem *mem) {
+  reader r;
+  uint64_t version;
+  cmark_node *root;
+
+  memset(&r, 0, sizeof(r));
+  r.mem = mem;
+  r.p = (const unsigned char *)data;
+  r.end = r.p + len;
+
+  if (len < SERIALIZE_MAGIC_LEN ||
+      memcmp(data, SERIALIZE_MAGIC, SERIALIZE_MAGIC_LEN) != 0)
+    return NULL;
+  r.p += SERIALIZE_MAGIC_LEN;
+  if (!read_uint(&r, &version) || version != SERIALIZE_VERSION)
+    return NULL;
+
+  root = read_tree(&r);
+
+  mem->free(r.extensions);
+  mem->free(r.footnote_defs);
+  mem->free(r.links);
+
+  return root;
+}
+
+cmark_node *cmark_deserialize(const char *data, size_t len) {
+  return cmark_deserialize_with_mem(data, len,
+                                    cmark_get_default_mem_allocator());
+}
@@ -16,6 +16,7 @@ void cmark_syntax_extension_free(cmark_mem *mem, cmark_syntax_extension *extensi
   }
 
   cmark_llist_free(mem, extension->special_inline_chars);
+  cmark_llist_free(mem, extension->block_start_chars);
   mem->free(extension->name);
   mem->free(extension);
 }
@@ -73,6 +74,16 @@ void cmark_syntax_extension_set_special_inline_chars(cmark_syntax_extension *ext
   extension->special_inline_chars = special_chars;
 }
 
+void cmark_syntax_extension_set_block_start_chars(cmark_syntax_extension *extension,
+                                                   cmark_llist *start_chars) {
+  cmark_llist *tmp;
+
+  extension->block_start_chars = start_chars;
+  memset(extension->block_start_table, 0, sizeof(extension->block_start_table));
+  for (tmp = start_chars; tmp; tmp = tmp->next)
+    extension->block_start_table[(unsigned char)(size_t)tmp->data] = true;
+}
+
 void cmark_syntax_extension_set_get_type_string_func(cmark_syntax_extension *extension,
                                                      cmark_get_type_string_func func) {
   extension->get_type_string_func = func;
@@ -149,6 +160,16 @@ void cmark_syntax_extension_set_opaque_free_func(cmark_syntax_extension *extensi
   extension->opaque_free_func = func;
 }
 
+void cmark_syntax_extension_set_opaque_serialize_func(cmark_syntax_extension *extension,
+                                                      cmark_opaque_serialize_func func) {
+  extension->opaque_serialize_func = func;
+}
+
+void cmark_syntax_extension_set_opaque_deserialize_func(cmark_syntax_extension *extension,
+                                                        cmark_opaque_deserialize_func func) {
+  extension->opaque_deserialize_func = func;
+}
+
 void cmark_syntax_extension_set_commonmark_escape_func(cmark_syntax_extension *extension,
                                                        cmark_commonmark_escape_func func) {
   extension->commonmark_escape_func = func;
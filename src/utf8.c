@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <assert.h>
 
 #include "cmark_ctype.h"
@@ -107,6 +108,322 @@ static int utf8proc_valid(const uint8_t *str, bufsize_t str_len) {
   return length;
 }
 
+// Whole-buffer validation, see cmark_utf8proc_is_valid.
+//
+// The vector implementations use the lookup table algorithm of Keiser and
+// Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte" (2021):
+// the high and low nibbles of each byte and the high nibble of the byte
+// after it index three 16-entry tables whose AND flags every invalid
+// two-byte pattern, and a saturating subtraction finds the bytes that must
+// be the third or fourth of a sequence.
+
+#define UTF8_TOO_SHORT (1 << 0)
+#define UTF8_TOO_LONG (1 << 1)
+#define UTF8_OVERLONG_3 (1 << 2)
+#define UTF8_TOO_LARGE (1 << 3)
+#define UTF8_SURROGATE (1 << 4)
+#define UTF8_OVERLONG_2 (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4 (1 << 6)
+#define UTF8_TWO_CONTS (1 << 7)
+#define UTF8_CARRY (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+// Indexed by the high nibble of the first byte.
+static const uint8_t utf8_byte_1_high[16] = {
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+    UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+    UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4};
+
+// Indexed by the low nibble of the first byte.
+static const uint8_t utf8_byte_1_low[16] = {
+    UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_OVERLONG_2,
+    UTF8_CARRY,
+    UTF8_CARRY,
+    UTF8_CARRY | UTF8_TOO_LARGE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000};
+
+// Indexed by the high nibble of the second byte.
+static const uint8_t utf8_byte_2_high[16] = {
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 |
+        UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 |
+        UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE |
+        UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE |
+        UTF8_TOO_LARGE,
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT};
+
+// A lead byte in one of the last positions of a block is only valid if the
+// next block holds the rest of its sequence: subtracting these with
+// saturation leaves a non-zero byte there.
+static const uint8_t utf8_max_last[32] = {
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1};
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define UTF8_NEON 1
+#elif (defined(__x86_64__) || defined(__i386__) || defined(_M_X64)) &&        \
+    (defined(__GNUC__) || defined(__AVX2__))
+#include <immintrin.h>
+#define UTF8_X86 1
+#if defined(__AVX2__)
+#define UTF8_TARGET_AVX2
+#define UTF8_TARGET_SSSE3
+#else
+// Compiled for any x86 CPU: pick the implementation at run time.
+#define UTF8_TARGET_AVX2 __attribute__((target("avx2")))
+#define UTF8_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define UTF8_DISPATCH 1
+#endif
+#endif
+
+#ifdef UTF8_NEON
+
+static inline uint8x16_t utf8_prev(uint8x16_t input, uint8x16_t prev, int n) {
+  switch (n) {
+  case 1:
+    return vextq_u8(prev, input, 15);
+  case 2:
+    return vextq_u8(prev, input, 14);
+  default:
+    return vextq_u8(prev, input, 13);
+  }
+}
+
+static bool utf8_valid_neon(const uint8_t *str, size_t len) {
+  const uint8x16_t byte_1_high = vld1q_u8(utf8_byte_1_high);
+  const uint8x16_t byte_1_low = vld1q_u8(utf8_byte_1_low);
+  const uint8x16_t byte_2_high = vld1q_u8(utf8_byte_2_high);
+  const uint8x16_t max_last = vld1q_u8(utf8_max_last + 16);
+  const uint8x16_t nibble = vdupq_n_u8(0x0F);
+  uint8x16_t error = vdupq_n_u8(0);
+  uint8x16_t prev_input = vdupq_n_u8(0);
+  uint8x16_t prev_incomplete = vdupq_n_u8(0);
+  uint8_t tail[16];
+  size_t i = 0;
+
+  while (i < len) {
+    uint8x16_t input;
+    if (len - i >= 16) {
+      input = vld1q_u8(str + i);
+    } else {
+      memset(tail, 0, sizeof(tail));
+      memcpy(tail, str + i, len - i);
+      input = vld1q_u8(tail);
+    }
+    i += 16;
+
+    if (vmaxvq_u8(input) < 0x80) {
+      error = vorrq_u8(error, prev_incomplete);
+    } else {
+      uint8x16_t prev1 = utf8_prev(input, prev_input, 1);
+      uint8x16_t special = vandq_u8(
+          vandq_u8(vqtbl1q_u8(byte_1_high, vshrq_n_u8(prev1, 4)),
+                   vqtbl1q_u8(byte_1_low, vandq_u8(prev1, nibble))),
+          vqtbl1q_u8(byte_2_high, vshrq_n_u8(input, 4)));
+      uint8x16_t third = vqsubq_u8(utf8_prev(input, prev_input, 2),
+                                   vdupq_n_u8(0xE0 - 0x80));
+      uint8x16_t fourth = vqsubq_u8(utf8_prev(input, prev_input, 3),
+                                    vdupq_n_u8(0xF0 - 0x80));
+      uint8x16_t must23 = vandq_u8(vorrq_u8(third, fourth), vdupq_n_u8(0x80));
+      error = vorrq_u8(error, veorq_u8(must23, special));
+      prev_incomplete = vqsubq_u8(input, max_last);
+    }
+    prev_input = input;
+  }
+
+  error = vorrq_u8(error, prev_incomplete);
+  return vmaxvq_u8(error) == 0;
+}
+
+#endif
+
+#ifdef UTF8_X86
+
+UTF8_TARGET_AVX2
+static bool utf8_valid_avx2(const uint8_t *str, size_t len) {
+  const __m256i byte_1_high = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((const __m128i *)utf8_byte_1_high));
+  const __m256i byte_1_low = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((const __m128i *)utf8_byte_1_low));
+  const __m256i byte_2_high = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((const __m128i *)utf8_byte_2_high));
+  const __m256i max_last = _mm256_loadu_si256((const __m256i *)utf8_max_last);
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  __m256i error = _mm256_setzero_si256();
+  __m256i prev_input = _mm256_setzero_si256();
+  __m256i prev_incomplete = _mm256_setzero_si256();
+  uint8_t tail[32];
+  size_t i = 0;
+
+  while (i < len) {
+    __m256i input;
+    if (len - i >= 32) {
+      input = _mm256_loadu_si256((const __m256i *)(str + i));
+    } else {
+      memset(tail, 0, sizeof(tail));
+      memcpy(tail, str + i, len - i);
+      input = _mm256_loadu_si256((const __m256i *)tail);
+    }
+    i += 32;
+
+    if (!_mm256_movemask_epi8(input)) {
+      error = _mm256_or_si256(error, prev_incomplete);
+    } else {
+      // The previous block's high lane followed by this block's low lane.
+      __m256i shifted = _mm256_permute2x128_si256(prev_input, input, 0x21);
+      __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+      __m256i special = _mm256_and_si256(
+          _mm256_and_si256(
+              _mm256_shuffle_epi8(
+                  byte_1_high,
+                  _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+              _mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(prev1, nibble))),
+          _mm256_shuffle_epi8(
+              byte_2_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+      __m256i third = _mm256_subs_epu8(_mm256_alignr_epi8(input, shifted, 14),
+                                       _mm256_set1_epi8((char)(0xE0 - 0x80)));
+      __m256i fourth = _mm256_subs_epu8(_mm256_alignr_epi8(input, shifted, 13),
+                                        _mm256_set1_epi8((char)(0xF0 - 0x80)));
+      __m256i must23 = _mm256_and_si256(_mm256_or_si256(third, fourth),
+                                        _mm256_set1_epi8((char)0x80));
+      error = _mm256_or_si256(error, _mm256_xor_si256(must23, special));
+      prev_incomplete = _mm256_subs_epu8(input, max_last);
+    }
+    prev_input = input;
+  }
+
+  error = _mm256_or_si256(error, prev_incomplete);
+  return _mm256_testz_si256(error, error);
+}
+
+#ifdef UTF8_DISPATCH
+
+UTF8_TARGET_SSSE3
+static bool utf8_valid_ssse3(const uint8_t *str, size_t len) {
+  const __m128i byte_1_high = _mm_loadu_si128((const __m128i *)utf8_byte_1_high);
+  const __m128i byte_1_low = _mm_loadu_si128((const __m128i *)utf8_byte_1_low);
+  const __m128i byte_2_high = _mm_loadu_si128((const __m128i *)utf8_byte_2_high);
+  const __m128i max_last =
+      _mm_loadu_si128((const __m128i *)(utf8_max_last + 16));
+  const __m128i nibble = _mm_set1_epi8(0x0F);
+  __m128i error = _mm_setzero_si128();
+  __m128i prev_input = _mm_setzero_si128();
+  __m128i prev_incomplete = _mm_setzero_si128();
+  uint8_t tail[16];
+  size_t i = 0;
+
+  while (i < len) {
+    __m128i input;
+    if (len - i >= 16) {
+      input = _mm_loadu_si128((const __m128i *)(str + i));
+    } else {
+      memset(tail, 0, sizeof(tail));
+      memcpy(tail, str + i, len - i);
+      input = _mm_loadu_si128((const __m128i *)tail);
+    }
+    i += 16;
+
+    if (!_mm_movemask_epi8(input)) {
+      error = _mm_or_si128(error, prev_incomplete);
+    } else {
+      __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+      __m128i special = _mm_and_si128(
+          _mm_and_si128(
+              _mm_shuffle_epi8(byte_1_high,
+                               _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+              _mm_shuffle_epi8(byte_1_low, _mm_and_si128(prev1, nibble))),
+          _mm_shuffle_epi8(byte_2_high,
+                           _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+      __m128i third = _mm_subs_epu8(_mm_alignr_epi8(input, prev_input, 14),
+                                    _mm_set1_epi8((char)(0xE0 - 0x80)));
+      __m128i fourth = _mm_subs_epu8(_mm_alignr_epi8(input, prev_input, 13),
+                                     _mm_set1_epi8((char)(0xF0 - 0x80)));
+      __m128i must23 = _mm_and_si128(_mm_or_si128(third, fourth),
+                                     _mm_set1_epi8((char)0x80));
+      error = _mm_or_si128(error, _mm_xor_si128(must23, special));
+      prev_incomplete = _mm_subs_epu8(input, max_last);
+    }
+    prev_input = input;
+  }
+
+  error = _mm_or_si128(error, prev_incomplete);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) ==
+         0xFFFF;
+}
+
+#endif
+#endif
+
+static bool utf8_valid_scalar(const uint8_t *str, size_t len) {
+  size_t i = 0;
+  int charlen;
+
+  while (i < len) {
+    // Skip ASCII eight bytes at a time.
+    while (len - i >= 8) {
+      uint64_t word;
+      memcpy(&word, str + i, sizeof(word));
+      if (word & UINT64_C(0x8080808080808080))
+        break;
+      i += 8;
+    }
+    if (i >= len)
+      break;
+    if (str[i] < 0x80) {
+      i++;
+      continue;
+    }
+    charlen = utf8proc_valid(str + i,
+                             len - i > 4 ? 4 : (bufsize_t)(len - i));
+    if (charlen < 0)
+      return false;
+    i += charlen;
+  }
+
+  return true;
+}
+
+bool cmark_utf8proc_is_valid(const uint8_t *str, size_t len) {
+  // Not worth setting up the vector registers for.
+  if (len < 16)
+    return utf8_valid_scalar(str, len);
+
+#if defined(UTF8_NEON)
+  return utf8_valid_neon(str, len);
+#elif defined(UTF8_X86) && !defined(UTF8_DISPATCH)
+  return utf8_valid_avx2(str, len);
+#elif defined(UTF8_X86)
+  if (__builtin_cpu_supports("avx2"))
+    return utf8_valid_avx2(str, len);
+  if (__builtin_cpu_supports("ssse3"))
+    return utf8_valid_ssse3(str, len);
+  return utf8_valid_scalar(str, len);
+#else
+  return utf8_valid_scalar(str, len);
+#endif
+}
+
 void cmark_utf8proc_check(cmark_strbuf *ob, const uint8_t *line,
                           bufsize_t size) {
   bufsize_t i = 0;
@@ -224,20 +541,49 @@ void cmark_utf8proc_encode_char(int32_t uc, cmark_strbuf *buf) {
   cmark_strbuf_put(buf, dst, len);
 }
 
-void cmark_utf8proc_case_fold(cmark_strbuf *dest, const uint8_t *str,
-                              bufsize_t len) {
+#include "case_fold.inc"
+
+bufsize_t cmark_utf8proc_case_fold_char(const uint8_t *str, bufsize_t len,
+                                        uint8_t *dest, bufsize_t *dest_len) {
+  static const uint8_t repl[] = {239, 191, 189};
   int32_t c;
+  bufsize_t char_len = cmark_utf8proc_iterate(str, len, &c);
+
+  if (char_len < 0) {
+    memcpy(dest, repl, 3);
+    *dest_len = 3;
+    return 1;
+  }
 
-#define bufpush(x) cmark_utf8proc_encode_char(x, dest)
+  if (c < CMARK_CASE_FOLD_LIMIT) {
+    const uint8_t *fold = cmark_case_fold_utf8[cmark_case_fold_index
+        [cmark_case_fold_blocks[c >> 8]][c & 0xFF]];
+    if (fold[0]) {
+      memcpy(dest, fold + 1, fold[0]);
+      *dest_len = fold[0];
+      return char_len;
+    }
+  }
+
+  memcpy(dest, str, char_len);
+  *dest_len = char_len;
+  return char_len;
+}
+
+void cmark_utf8proc_case_fold(cmark_strbuf *dest, const uint8_t *str,
+                              bufsize_t len) {
+  uint8_t fold[CMARK_CASE_FOLD_MAX_LENGTH];
+  bufsize_t fold_len;
 
   while (len > 0) {
-    bufsize_t char_len = cmark_utf8proc_iterate(str, len, &c);
+    bufsize_t char_len;
 
-    if (char_len >= 0) {
-#include "case_fold_switch.inc"
+    if (*str < 0x80) {
+      cmark_strbuf_putc(dest, *str >= 'A' && *str <= 'Z' ? *str + 32 : *str);
+      char_len = 1;
     } else {
-      encode_unknown(dest);
-      char_len = -char_len;
+      char_len = cmark_utf8proc_case_fold_char(str, len, fold, &fold_len);
+      cmark_strbuf_put(dest, fold, fold_len);
     }
 
     str += char_len;
@@ -9,10 +9,14 @@
 #include "buffer.h"
 #include "houdini.h"
 #include "syntax_extension.h"
+#include "render.h"
 
 #define BUFFER_SIZE 100
 #define MAX_INDENT 40
 
+// Average number of bytes of elements each node adds to the XML output.
+#define XML_BYTES_PER_NODE 40
+
 // Functions to convert cmark_nodes to XML strings.
 
 static void escape_xml(cmark_strbuf *dest, const unsigned char *source,
@@ -163,23 +167,55 @@ char *cmark_render_xml(cmark_node *root, int options) {
 }
 
 char *cmark_render_xml_with_mem(cmark_node *root, int options, cmark_mem *mem) {
-  char *result;
-  cmark_strbuf xml = CMARK_BUF_INIT(mem);
-  cmark_event_type ev_type;
-  cmark_node *cur;
-  struct render_state state = {&xml, 0};
+  return cmark_render_xml_with_mem_and_capacity(root, options, mem, 0);
+}
 
-  cmark_iter *iter = cmark_iter_new(root);
+typedef struct {
+  cmark_render_sink sink;
+  struct render_state state;
+  cmark_strbuf xml;
+  cmark_mem *mem;
+  int options;
+} xml_sink;
+
+static int S_sink_render_node(cmark_render_sink *sink, cmark_node *node,
+                              cmark_event_type ev_type) {
+  xml_sink *xs = (xml_sink *)sink;
+  S_render_node(node, ev_type, &xs->state, xs->options);
+  return 1;
+}
 
-  cmark_strbuf_puts(state.xml, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
-  cmark_strbuf_puts(state.xml,
-                    "<!DOCTYPE document SYSTEM \"CommonMark.dtd\">\n");
-  while ((ev_type = cmark_iter_next(iter)) != CMARK_EVENT_DONE) {
-    cur = cmark_iter_get_node(iter);
-    S_render_node(cur, ev_type, &state, options);
-  }
-  result = (char *)cmark_strbuf_detach(&xml);
+static char *S_sink_finish(cmark_render_sink *sink) {
+  xml_sink *xs = (xml_sink *)sink;
+  char *result = (char *)cmark_strbuf_detach(&xs->xml);
 
-  cmark_iter_free(iter);
+  xs->mem->free(xs);
   return result;
 }
+
+cmark_render_sink *cmark_xml_sink_new(cmark_mem *mem, cmark_node *root,
+                                      int options, size_t capacity) {
+  xml_sink *xs = (xml_sink *)mem->calloc(1, sizeof(*xs));
+
+  xs->sink.render_node = S_sink_render_node;
+  xs->sink.finish = S_sink_finish;
+  xs->mem = mem;
+  xs->options = options;
+  xs->state.xml = &xs->xml;
+  xs->state.indent = 0;
+
+  cmark_strbuf_init(mem, &xs->xml,
+                    cmark_render_size_hint(root, capacity, XML_BYTES_PER_NODE));
+
+  cmark_strbuf_puts(xs->state.xml, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+  cmark_strbuf_puts(xs->state.xml,
+                    "<!DOCTYPE document SYSTEM \"CommonMark.dtd\">\n");
+
+  return &xs->sink;
+}
+
+char *cmark_render_xml_with_mem_and_capacity(cmark_node *root, int options,
+                                             cmark_mem *mem, size_t capacity) {
+  return cmark_render_sink_run(root,
+                               cmark_xml_sink_new(mem, root, options, capacity));
+}
@@ -1,4 +1,4 @@
-# Creates C data structures for binary lookup table of entities,
+# Creates C data structures for a perfect hash lookup table of entities,
 # using python's html5 entity data.
 # Usage: python3 tools/make_entities_inc.py > src/entities.inc
 
@@ -11,6 +11,65 @@ entities5 = html.entities.html5
 # without a semicolon.
 entities = sorted([(k[:-1], entities5[k].encode('utf-8')) for k in entities5.keys() if k[-1] == ';'])
 
+# Minimal perfect hash, built with the "hash, displace" method: each name
+# is hashed once, the hash picks a bucket, and the bucket's displacement
+# either gives the slot of its single name directly (when negative) or is
+# mixed into the hash to give each of its names a free slot.  The table is
+# stored in slot order, so a lookup ends with a single comparison.
+#
+# These must match the C functions printed below.
+
+MASK = 0xFFFFFFFF
+
+def entity_hash(name):
+  h = 2166136261
+  for c in name.encode('ascii'):
+    h = ((h ^ c) * 16777619) & MASK
+  return h
+
+def entity_mix(h):
+  h ^= h >> 16
+  h = (h * 0x85EBCA6B) & MASK
+  h ^= h >> 13
+  h = (h * 0xC2B2AE35) & MASK
+  h ^= h >> 16
+  return h
+
+num_entities = len(entities)
+num_buckets = (num_entities + 3) // 4
+
+hashes = [entity_hash(ent) for (ent, bs) in entities]
+assert len(set(hashes)) == num_entities, "entity hash collision"
+
+buckets = [[] for b in range(num_buckets)]
+for (i, h) in enumerate(hashes):
+  buckets[h % num_buckets].append(i)
+
+displacements = [0] * num_buckets
+slots = [None] * num_entities
+
+for b in sorted(range(num_buckets), key=lambda b: -len(buckets[b])):
+  if len(buckets[b]) < 2:
+    continue
+  d = 1
+  while True:
+    ss = [entity_mix(hashes[i] ^ d) % num_entities for i in buckets[b]]
+    if len(set(ss)) == len(ss) and all(slots[s] is None for s in ss):
+      break
+    d += 1
+  displacements[b] = d
+  for (i, s) in zip(buckets[b], ss):
+    slots[s] = i
+
+free = [s for s in range(num_entities) if slots[s] is None]
+for b in range(num_buckets):
+  if len(buckets[b]) == 1:
+    s = free.pop()
+    displacements[b] = -s - 1
+    slots[s] = buckets[b][0]
+
+assert not free
+
 # Print out the header:
 print("""/* Autogenerated by tools/make_headers_inc.py */
 
@@ -22,11 +81,38 @@ struct cmark_entity_node {
 #define CMARK_ENTITY_MIN_LENGTH 2
 #define CMARK_ENTITY_MAX_LENGTH 32""")
 
-print("#define CMARK_NUM_ENTITIES " + str(len(entities)));
+print("#define CMARK_NUM_ENTITIES " + str(num_entities));
+print("#define CMARK_ENTITY_BUCKETS " + str(num_buckets));
+
+print("""
+static inline uint32_t cmark_entity_hash(const unsigned char *s, int len) {
+  uint32_t h = 2166136261u;
+  int i;
+  for (i = 0; i < len; ++i)
+    h = (h ^ s[i]) * 16777619u;
+  return h;
+}
+
+static inline uint32_t cmark_entity_mix(uint32_t h) {
+  h ^= h >> 16;
+  h *= 0x85EBCA6Bu;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35u;
+  h ^= h >> 16;
+  return h;
+}""")
+
+print("\nstatic const int32_t cmark_entity_displacements[] = {");
+
+for i in range(0, num_buckets, 12):
+  print(' ' + ''.join(' ' + str(d) + ',' for d in displacements[i:i + 12]))
+
+print("};")
 
 print("\nstatic const struct cmark_entity_node cmark_entities[] = {");
 
-for (ent, bs) in entities:
+for i in slots:
+  (ent, bs) = entities[i]
   print('{(unsigned char*)"' + ent + '", {' + ', '.join(map(str, bs)) + ', 0}},')
 
 print("};")
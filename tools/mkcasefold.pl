@@ -1,22 +1,98 @@
 binmode STDOUT;
-print("    switch (c) {\n");
-my $lastchar = "";
+
+# Reads CaseFolding.txt and prints a two-level lookup table of the C and F
+# foldings: the high bits of a code point select a block of 256 entries,
+# and the entry is the 1-based index of the folding's UTF-8 encoding, or 0
+# when the code point folds to itself.
+
+my %folds;
+my @order;
 while (<STDIN>) {
   if (/^[A-F0-9]/ and / [CF]; /) {
     my ($char, $type, $subst) = m/([A-F0-9]+); ([CF]); ([^;]+)/;
-    if ($char eq $lastchar) {
-      break;
-    }
-    my @subst = $subst =~ m/(\w+)/g;
-    printf("      case 0x%s:\n", $char);
-    foreach (@subst) {
-      printf("        bufpush(0x%s);\n", $_);
+    my $c = hex($char);
+    next if exists $folds{$c};
+    my @subst = map { hex($_) } ($subst =~ m/(\w+)/g);
+    $folds{$c} = \@subst;
+    push @order, $c;
+  }
+}
+
+sub utf8_bytes {
+  my @bytes;
+  foreach my $c (@_) {
+    if ($c < 0x80) {
+      push @bytes, $c;
+    } elsif ($c < 0x800) {
+      push @bytes, 0xC0 | ($c >> 6), 0x80 | ($c & 0x3F);
+    } elsif ($c < 0x10000) {
+      push @bytes, 0xE0 | ($c >> 12), 0x80 | (($c >> 6) & 0x3F),
+          0x80 | ($c & 0x3F);
+    } else {
+      push @bytes, 0xF0 | ($c >> 18), 0x80 | (($c >> 12) & 0x3F),
+          0x80 | (($c >> 6) & 0x3F), 0x80 | ($c & 0x3F);
     }
-    printf("        break;\n");
-    $lastchar = $char;
   }
+  return @bytes;
+}
+
+my %index;
+my $max_len = 0;
+for my $i (0 .. $#order) {
+  $index{$order[$i]} = $i + 1;
+  my $len = scalar(utf8_bytes(@{$folds{$order[$i]}}));
+  $max_len = $len if $len > $max_len;
+}
+
+# utf8.h promises callers of cmark_utf8proc_case_fold_char this bound.
+die "foldings longer than CMARK_CASE_FOLD_MAX_LENGTH" if $max_len > 6;
+
+my $num_blocks = (sort { $b <=> $a } @order)[0] / 256 + 1;
+$num_blocks = int($num_blocks);
+
+# Block 0 of the index table is all zeros and is shared by every block of
+# code points without foldings.
+my @block_of;
+my @blocks = ([(0) x 256]);
+for my $hi (0 .. $num_blocks - 1) {
+  my @entries = map { $index{$hi * 256 + $_} // 0 } (0 .. 255);
+  if (grep { $_ } @entries) {
+    push @blocks, \@entries;
+    push @block_of, $#blocks;
+  } else {
+    push @block_of, 0;
+  }
+}
+
+printf("/* Autogenerated by tools/mkcasefold.pl */\n\n");
+printf("#define CMARK_CASE_FOLD_LIMIT 0x%X\n\n", $num_blocks * 256);
+
+printf("static const uint8_t cmark_case_fold_blocks[%d] = {\n", $num_blocks);
+for (my $i = 0; $i < $num_blocks; $i += 16) {
+  my $end = $i + 15 < $num_blocks - 1 ? $i + 15 : $num_blocks - 1;
+  print("   ", join("", map { sprintf(" %d,", $_) } @block_of[$i .. $end]), "\n");
+}
+printf("};\n\n");
+
+printf("static const uint16_t cmark_case_fold_index[%d][256] = {\n",
+       scalar(@blocks));
+foreach my $block (@blocks) {
+  print("  {\n");
+  for (my $i = 0; $i < 256; $i += 16) {
+    print("   ", join("", map { sprintf(" %d,", $_) } @{$block}[$i .. $i + 15]),
+          "\n");
+  }
+  print("  },\n");
 }
-printf("      default:\n");
-printf("        bufpush(c);\n");
-print("    }\n");
+printf("};\n\n");
 
+# Each folding is stored as its length followed by its UTF-8 bytes.
+printf("static const uint8_t cmark_case_fold_utf8[%d][%d] = {\n",
+       scalar(@order) + 1, $max_len + 1);
+printf("    {0},\n");
+foreach my $c (@order) {
+  my @bytes = utf8_bytes(@{$folds{$c}});
+  printf("    {%d, %s}, /* U+%04X */\n", scalar(@bytes),
+         join(", ", map { sprintf("0x%02X", $_) } @bytes), $c);
+}
+printf("};\n");